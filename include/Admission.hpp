@@ -0,0 +1,48 @@
+#ifndef ADMISSION_HPP
+#define ADMISSION_HPP
+
+// Connection admission, checked right after accept() and before any Client
+// exists: a global cap on connections and a cap per IPv4 source, where sources
+// are grouped by a prefix length (/32 = per address, /24 = per subnet, ...).
+// Shared by all shards: one short mutex hold per accept and per close, so
+// command traffic never touches it.
+
+#include <vector>
+#include <cstddef>
+#include <pthread.h>
+
+class Admission {
+    // Open addressing, linear probing; count == 0 marks an empty slot.
+    struct Slot {
+        unsigned key;     // source address & _mask
+        unsigned count;
+    };
+    pthread_mutex_t   _lock;
+    std::vector<Slot> _slots;    // power-of-two size
+    size_t            _used;
+    size_t            _total;    // admitted and not yet released
+    size_t            _maxClients;
+    size_t            _maxPerSource;
+    unsigned          _mask;
+
+    Admission(const Admission &);
+    Admission &operator=(const Admission &);
+
+    size_t home(unsigned key) const;
+    Slot *find(unsigned key);
+    void grow();
+    void erase(size_t i);
+public:
+    enum Verdict { OK, SERVER_FULL, SOURCE_FULL };
+
+    // 0 means no limit; prefixLen is 1..32.
+    Admission(size_t maxClients, size_t maxPerSource, size_t prefixLen);
+    ~Admission();
+
+    Verdict admit(unsigned ip);   // ip in host order; counts it on OK
+    void release(unsigned ip);    // once per admitted connection
+    size_t total();
+    size_t sources();             // distinct sources currently connected
+};
+
+#endif
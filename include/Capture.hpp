@@ -0,0 +1,37 @@
+#ifndef CAPTURE_HPP
+#define CAPTURE_HPP
+
+// Optional record of everything clients send (--capture=PATH), for replaying a
+// real session against a fresh server (tools/replay.cpp). Shards append records
+// to a private buffer while they work and hand it over once per loop iteration,
+// so the file lock is taken at most once per iteration per shard.
+//
+// File: "IRCCAP1\n", then records, all integers little-endian:
+//   u64 ns since capture start | u64 connection id | u8 type | u32 length | bytes
+// OPEN and CLOSE records have no bytes; connection ids are Client::id().
+
+#include <string>
+#include <cstdio>
+#include <pthread.h>
+
+class Capture {
+    std::FILE      *_file;
+    pthread_mutex_t _lock;
+    unsigned long   _start;   // monoNs() at open()
+
+    Capture(const Capture &);
+    Capture &operator=(const Capture &);
+public:
+    enum Type { OPEN = 0, DATA = 1, CLOSE = 2 };
+    static const char kMagic[9];
+
+    Capture();
+    ~Capture();
+    bool open(const std::string &path);
+    // Append one record to out (no I/O).
+    void record(std::string &out, unsigned long conn, Type type, const char *data = 0, size_t len = 0) const;
+    // Write and clear a batch of records (any thread).
+    void write(std::string &batch);
+};
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef CASEMAP_HPP
+#define CASEMAP_HPP
+
+// Case-insensitive names. Nicks and channels compare equal under the server's
+// casemapping (advertised as CASEMAPPING in RPL_ISUPPORT): "ascii" folds A-Z,
+// "rfc1459" also folds []\^ onto {}|~. Hashing and comparing fold eight bytes
+// at a time in place, so a lookup never builds a lowered copy of the key.
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include "StrRef.hpp"
+
+enum CaseMapping { CASEMAP_RFC1459, CASEMAP_ASCII };
+
+const char *caseMappingName(CaseMapping m);
+size_t caseHash(CaseMapping m, const char *s, size_t n);
+bool caseEqual(CaseMapping m, const char *a, const char *b, size_t n);
+
+// Open-addressing hash table (linear probing, backward-shift erase) keyed by
+// names under a casemapping. The key keeps the spelling it was inserted with.
+template <class V>
+class CaseTable {
+    struct Slot {
+        std::string key;
+        V           value;
+        size_t      hash;
+        bool        used;
+        Slot() : value(), hash(0), used(false) {}
+    };
+    CaseMapping       _map;
+    std::vector<Slot> _slots;   // power-of-two size, at most 3/4 used
+    size_t            _size;
+
+    size_t slotOf(const StrRef &k, size_t h) const {
+        size_t mask = _slots.size() - 1;
+        for (size_t i = h & mask; ; i = (i + 1) & mask) {
+            const Slot &s = _slots[i];
+            if (!s.used) return i;
+            if (s.hash == h && s.key.size() == k.len && caseEqual(_map, s.key.data(), k.data, k.len))
+                return i;
+        }
+    }
+    void grow() {
+        std::vector<Slot> old;
+        old.swap(_slots);
+        _slots.resize(old.size() * 2);
+        for (size_t i = 0; i < old.size(); ++i) {
+            if (!old[i].used) continue;
+            Slot &s = _slots[slotOf(old[i].key, old[i].hash)];
+            s.key.swap(old[i].key);
+            s.value = old[i].value;
+            s.hash = old[i].hash;
+            s.used = true;
+        }
+    }
+public:
+    explicit CaseTable(CaseMapping m) : _map(m), _slots(16), _size(0) {}
+
+    size_t size() const { return _size; }
+
+    V *find(const StrRef &k) {
+        Slot &s = _slots[slotOf(k, caseHash(_map, k.data, k.len))];
+        return s.used ? &s.value : 0;
+    }
+    // Adds or replaces.
+    void set(const std::string &k, const V &v) {
+        if ((_size + 1) * 4 > _slots.size() * 3) grow();
+        size_t h = caseHash(_map, k.data(), k.size());
+        Slot &s = _slots[slotOf(k, h)];
+        if (!s.used) {
+            s.key = k;
+            s.hash = h;
+            s.used = true;
+            ++_size;
+        }
+        s.value = v;
+    }
+    bool erase(const StrRef &k) {
+        size_t mask = _slots.size() - 1;
+        size_t i = slotOf(k, caseHash(_map, k.data, k.len));
+        if (!_slots[i].used) return false;
+        // Pull later entries of the probe run back into the hole, unless that
+        // would move them before their home slot.
+        for (size_t j = (i + 1) & mask; _slots[j].used; j = (j + 1) & mask) {
+            size_t home = _slots[j].hash & mask;
+            bool between = i < j ? (home > i && home <= j) : (home > i || home <= j);
+            if (between) continue;
+            _slots[i].key.swap(_slots[j].key);
+            _slots[i].value = _slots[j].value;
+            _slots[i].hash = _slots[j].hash;
+            i = j;
+        }
+        _slots[i] = Slot();
+        --_size;
+        return true;
+    }
+    void clear() { _slots.assign(16, Slot()); _size = 0; }
+
+    // Iteration over slots: for (i < slots()) if (usedAt(i)) ... valueAt(i).
+    size_t slots() const { return _slots.size(); }
+    bool usedAt(size_t i) const { return _slots[i].used; }
+    V &valueAt(size_t i) { return _slots[i].value; }
+};
+
+#endif
@@ -3,10 +3,21 @@
 #define CHANNEL_HPP
 
 // A Channel tracks its members, operators and various modes required by subject.
+// Members are kept in a vector sorted by fd, each with a byte of flags, so a
+// broadcast is a linear walk over contiguous memory and a lookup a binary search.
+// The NAMES list is kept ready to send, already split into 353-sized pieces, and
+// patched on join/part/op/nick instead of being rebuilt for every JOIN.
 
 #include <string>
-#include <set>
-#include <map>
+#include <vector>
+#include <cstddef>
+
+struct Member {
+    enum { OP = 1 };          // flags
+    int           fd;
+    unsigned char flags;
+    unsigned short chunk;     // index of the names() piece holding this member
+};
 
 class Channel {
     std::string _name;        // "#name"
@@ -18,12 +29,20 @@ class Channel {
     std::string _key;         // key if +k
     bool        _hasLimit;    // +l
     size_t      _limit;       // user limit if +l
-    // Fds of members and operators
-    std::set<int> _members;
-    std::set<int> _operators;
-    std::set<int> _invited;   // for +i logic
+    std::vector<Member> _members; // sorted by fd
+    std::vector<int> _invited;    // for +i logic, oldest first, at most kMaxInvites
+    std::vector<std::string> _names; // "@op nick ..." pieces, each at most _namesRoom bytes
+    size_t      _namesRoom;
+
+    size_t find(int fd) const;    // index of the first member with fd >= fd
+    void setFlag(int fd, const std::string &nick, unsigned char flag, bool on);
+    void namesAdd(Member &m, const std::string &nick);
+    void namesRemove(const Member &m, const std::string &nick);
 public:
-    Channel(const std::string &name);
+    static const size_t kMaxInvites = 32;
+
+    // namesRoom: bytes left for names in one 353 line of this channel.
+    Channel(const std::string &name, size_t namesRoom);
     const std::string &name() const { return _name; }
     const std::string &topic() const { return _topic; }
     void setTopic(const std::string &t) { _topic = t; }
@@ -41,18 +60,20 @@ public:
     void setLimit(size_t l) { _hasLimit = true; _limit = l; }
     void clearLimit() { _hasLimit = false; _limit = 0; }
 
-    const std::set<int> &members() const { return _members; }
-    const std::set<int> &operators() const { return _operators; }
-    const std::set<int> &invited() const { return _invited; }
+    const std::vector<Member> &members() const { return _members; }
+    // Payloads for RPL_NAMREPLY, one line each; some may be empty.
+    const std::vector<std::string> &names() const { return _names; }
 
     bool isMember(int fd) const;
     bool isOperator(int fd) const;
     bool isInvited(int fd) const;
-    void addMember(int fd);
-    void removeMember(int fd);
-    void addOperator(int fd);
-    void removeOperator(int fd);
-    void addInvite(int fd);
+    // The member's current nick is needed to keep names() up to date.
+    void addMember(int fd, const std::string &nick);
+    void removeMember(int fd, const std::string &nick);
+    void addOperator(int fd, const std::string &nick);
+    void removeOperator(int fd, const std::string &nick);
+    void renameMember(int fd, const std::string &from, const std::string &to);
+    void addInvite(int fd);       // forgets the oldest invite when full
     void clearInvite(int fd);
     size_t memberCount() const { return _members.size(); }
 };
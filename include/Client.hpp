@@ -7,42 +7,118 @@
 
 #include <string>
 #include <set>
+#include <vector>
+
+#include "OutQueue.hpp"
+#include "InBuf.hpp"
+#include "TimerWheel.hpp"
+
+class Channel;
 
 class Client {
     // Each client is identified by its socket file descriptor (fd).
     int         _fd;
+    // Unique for the life of the server, unlike fds (which get reused).
+    unsigned long _id;
     // Buffered incoming data until we reach a full IRC line (\r\n or \n).
-    std::string _inbuf;
-    // Outgoing data to write when POLLOUT is ready.
-    std::string _outbuf;
+    InBuf       _inbuf;
+    // Outgoing data to write when POLLOUT is ready (chunked; broadcasts by reference).
+    OutQueue    _out;
     // Registration/identity fields.
     std::string _nick;
     std::string _user;
     std::string _realname;
+    std::string _host;
+    unsigned    _ip;          // IPv4 source, host order (Admission key)
+    // ":nick!user@host " for messages from this client; rebuilt when any part changes.
+    std::string _prefix;
     bool        _passOk;      // true only after PASS <password> matches
     bool        _registered;  // set true after PASS+NICK+USER succeeds
+    bool        _readPaused;  // --recvq reached: not reading until input drains
+    bool        _evicted;     // --sendq exceeded: no more output, being dropped
+    bool        _inputQueued; // listed for Shard::processInput()
+    bool        _throttled;   // held back by flood control, backlog not yet run
+    bool        _writable;    // POLLOUT reported and no short write since
+    bool        _flushQueued; // listed for Shard::flushDirty()
+    // Channels this client is in (reverse of Channel::members()), in join order.
+    std::vector<Channel*> _channels;
+    // Timeouts (Shard::checkTimeouts); monotonic ms. Input only moves the
+    // timestamps, the timer is re-armed from them when it fires.
+    TimerWheel::Timer _timer;
+    unsigned long _connectedMs;
+    unsigned long _lastInputMs;   // any bytes received
+    unsigned long _lastActiveMs;  // last command other than PING/PONG
+    unsigned long _pingSentMs;    // last server PING; answered once input follows
+    // Flood control: each line run moves this clock forward by the line's cost;
+    // lines wait while it is too far ahead of now (Shard::processInput).
+    unsigned long _floodClockUs;  // microseconds: a line may cost 1/1000 s
+    TimerWheel::Timer _resumeTimer; // fires when throttled lines may run again
+
+    Client(const Client &);
+    Client &operator=(const Client &);
+    void updatePrefix();
 public:
     // Simple constructor takes the accepted socket descriptor.
     Client(int fd);
     // Accessors.
     int fd() const { return _fd; }
-    const std::string &inbuf() const { return _inbuf; }
-    const std::string &outbuf() const { return _outbuf; }
+    unsigned long id() const { return _id; }
+    const InBuf &inbuf() const { return _inbuf; }
+    InBuf &inbuf() { return _inbuf; } // recv() fills it in place
+    bool hasOut() const { return !_out.empty(); }
+    size_t outSize() const { return _out.size(); }
     const std::string &nick() const { return _nick; }
     const std::string &user() const { return _user; }
     const std::string &realname() const { return _realname; }
+    const std::string &host() const { return _host; }
+    unsigned ip() const { return _ip; }
+    const std::string &prefix() const { return _prefix; }
     bool passOk() const { return _passOk; }
     bool registered() const { return _registered; }
+    bool readPaused() const { return _readPaused; }
+    bool evicted() const { return _evicted; }
+    bool inputQueued() const { return _inputQueued; }
+    bool throttled() const { return _throttled; }
+    bool writable() const { return _writable; }
+    bool flushQueued() const { return _flushQueued; }
+    const std::vector<Channel*> &channels() const { return _channels; }
+    TimerWheel::Timer &timer() { return _timer; }
+    unsigned long connectedMs() const { return _connectedMs; }
+    unsigned long lastInputMs() const { return _lastInputMs; }
+    unsigned long lastActiveMs() const { return _lastActiveMs; }
+    unsigned long pingSentMs() const { return _pingSentMs; }
+    unsigned long floodClockUs() const { return _floodClockUs; }
+    TimerWheel::Timer &resumeTimer() { return _resumeTimer; }
     // Mutators.
-    void appendIn(const std::string &s) { _inbuf += s; }
-    void consumeIn(size_t n) { _inbuf.erase(0, n); }
-    void enqueueOut(const std::string &s) { _outbuf += s; }
-    void consumeOut(size_t n) { _outbuf.erase(0, n); }
-    void setNick(const std::string &n) { _nick = n; }
-    void setUser(const std::string &u) { _user = u; }
+    void enqueueOut(const std::string &s) { _out.append(s.data(), s.size()); }
+    void enqueueOut(const char *p, size_t n) { _out.append(p, n); }
+    void enqueueShared(SharedBuf *b) { _out.appendShared(b); } // takes its own reference
+    // Describe up to max unsent buffers as iovecs for writev/sendmsg.
+    int outIov(struct iovec *iov, int max) const { return _out.iov(iov, max); }
+    void consumeOut(size_t n) { _out.consume(n); }
+    size_t dropSharedOut(size_t need) { return _out.dropShared(need); }
+    void setId(unsigned long id) { _id = id; }
+    void setNick(const std::string &n) { _nick = n; updatePrefix(); }
+    void setUser(const std::string &u) { _user = u; updatePrefix(); }
+    void setHost(const std::string &h) { _host = h; updatePrefix(); }
+    void setAddress(unsigned ip);  // also sets host() to the dotted quad
     void setReal(const std::string &r) { _realname = r; }
     void setPassOk(bool v) { _passOk = v; }
     void setRegistered(bool v) { _registered = v; }
+    void setReadPaused(bool v) { _readPaused = v; }
+    void setEvicted() { _evicted = true; }
+    void setInputQueued(bool v) { _inputQueued = v; }
+    void setThrottled(bool v) { _throttled = v; }
+    void setWritable(bool v) { _writable = v; }
+    void setFlushQueued(bool v) { _flushQueued = v; }
+    // Kept in sync by Server::joinChannel()/partChannel().
+    void addChannel(Channel *ch) { _channels.push_back(ch); }
+    void removeChannel(Channel *ch);
+    void setConnected(unsigned long ms) { _connectedMs = _lastInputMs = _lastActiveMs = ms; }
+    void touchInput(unsigned long ms) { _lastInputMs = ms; }
+    void touchActive(unsigned long ms) { _lastActiveMs = ms; }
+    void setPingSent(unsigned long ms) { _pingSentMs = ms; }
+    void setFloodClock(unsigned long us) { _floodClockUs = us; }
 };
 
 #endif
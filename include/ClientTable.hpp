@@ -0,0 +1,43 @@
+#ifndef CLIENTTABLE_HPP
+#define CLIENTTABLE_HPP
+
+// fd-indexed slot table: each Client lives next to its backend interest bits.
+// Lookup, interest update and removal are O(1); live fds are also kept in a
+// dense array (swap-remove) so walking all clients never touches empty slots.
+
+#include <cstddef>
+#include <vector>
+
+class Client;
+
+class ClientTable {
+    struct Slot {
+        Client *client;   // 0 if the fd is not a client
+        int     dense;    // position in _fds
+        short   interest; // events currently registered with the backend
+        bool    closing;  // disconnected; fd is closed after the loop iteration
+    };
+    std::vector<Slot> _slots; // indexed by fd
+    std::vector<int>  _fds;   // live client fds, dense
+public:
+    // Live (not closing) client on fd, or 0.
+    Client *get(int fd) const {
+        if (fd < 0 || (size_t)fd >= _slots.size()) return 0;
+        const Slot &s = _slots[fd];
+        return s.closing ? 0 : s.client;
+    }
+    bool closing(int fd) const {
+        return fd >= 0 && (size_t)fd < _slots.size() && _slots[fd].closing;
+    }
+    void insert(int fd, Client *c, short interest);
+    // Record the new interest; true if it differs from what the backend has.
+    bool setInterest(int fd, short interest);
+    void markClosing(int fd);
+    // Swap-remove the slot and hand back its Client (caller deletes it).
+    Client *take(int fd);
+
+    size_t size() const { return _fds.size(); }
+    int fdAt(size_t i) const { return _fds[i]; }
+};
+
+#endif
@@ -3,28 +3,35 @@
 #define COMMANDS_HPP
 
 #include <string>
-#include <vector>
+#include "Parser.hpp"
 
 class Server;
 class Client;
 class Channel;
 
-// Each handler validates parameters, checks privileges and updates server state.
+// Each handler checks privileges and updates server state. Registration and the
+// minimum parameter count are checked before dispatch (see Server_handleLine.cpp).
 // Only features required by the subject are implemented.
 
 namespace CMD {
-    void PASS(Server &srv, int fd, const std::vector<std::string> &p);
-    void NICK(Server &srv, int fd, const std::vector<std::string> &p);
-    void USER(Server &srv, int fd, const std::vector<std::string> &p);
-    void JOIN(Server &srv, int fd, const std::vector<std::string> &p);
-    void PART(Server &srv, int fd, const std::vector<std::string> &p);
-    void PRIVMSG(Server &srv, int fd, const std::vector<std::string> &p);
-    void MODE(Server &srv, int fd, const std::vector<std::string> &p);
-    void TOPIC(Server &srv, int fd, const std::vector<std::string> &p);
-    void INVITE(Server &srv, int fd, const std::vector<std::string> &p);
-    void KICK(Server &srv, int fd, const std::vector<std::string> &p);
-    void PING(Server &srv, int fd, const std::vector<std::string> &p);
-    void QUIT(Server &srv, int fd, const std::vector<std::string> &p);
+    typedef void (*Handler)(Server &srv, int fd, const IrcParams &p);
+
+    void PASS(Server &srv, int fd, const IrcParams &p);
+    void NICK(Server &srv, int fd, const IrcParams &p);
+    void USER(Server &srv, int fd, const IrcParams &p);
+    void JOIN(Server &srv, int fd, const IrcParams &p);
+    void PART(Server &srv, int fd, const IrcParams &p);
+    void PRIVMSG(Server &srv, int fd, const IrcParams &p);
+    void NOTICE(Server &srv, int fd, const IrcParams &p);
+    void MODE(Server &srv, int fd, const IrcParams &p);
+    void TOPIC(Server &srv, int fd, const IrcParams &p);
+    void INVITE(Server &srv, int fd, const IrcParams &p);
+    void KICK(Server &srv, int fd, const IrcParams &p);
+    void WHOIS(Server &srv, int fd, const IrcParams &p);
+    void STATS(Server &srv, int fd, const IrcParams &p);
+    void PING(Server &srv, int fd, const IrcParams &p);
+    void PONG(Server &srv, int fd, const IrcParams &p);
+    void QUIT(Server &srv, int fd, const IrcParams &p);
 }
 
 #endif
@@ -0,0 +1,50 @@
+#ifndef CONFIG_HPP
+#define CONFIG_HPP
+
+// Optional tuning knobs, given after <port> <password> as --name=value.
+// Most defaults change nothing visible to clients. These do limit them:
+// keepalive (PING after 120 s of silence, drop 60 s later), a 60 s
+// registration deadline, a 1 MiB send queue (over it: disconnect), an 8 KiB
+// receive queue (full: stop reading), and flood control (25 lines/s, bursts
+// of 50, 16 lines per client per loop iteration). 0 turns off --ping-interval,
+// --registration-timeout, --sendq, --recvq and --flood-rate.
+
+#include <string>
+#include <cstddef>
+
+struct ServerConfig {
+    std::string backend;      // --backend=auto|poll|epoll|epoll-et
+    size_t      shards;       // --shards=N event-loop threads (SO_REUSEPORT listeners)
+    std::string casemapping;  // --casemapping=rfc1459|ascii for nicks and channel names
+    std::string metricsFile;  // --metrics-file=PATH: Prometheus text, rewritten periodically
+    size_t      metricsInterval; // --metrics-interval=SECONDS between rewrites
+    std::string capture;      // --capture=PATH: log of client input for tools/replay
+    // Timeouts in seconds, 0 = off (see Shard::checkTimeouts).
+    size_t      pingInterval;        // --ping-interval: PING a client silent this long
+    size_t      pingTimeout;         // --ping-timeout: drop it if still silent after the PING
+    size_t      registrationTimeout; // --registration-timeout: PASS/NICK/USER deadline
+    size_t      idleTimeout;         // --idle-timeout: drop after this long without a command
+    // Admission (see Admission.hpp); 0 = no limit.
+    size_t      maxClients;   // --max-clients: connections server-wide
+    size_t      maxPerIp;     // --max-per-ip: connections per source ...
+    size_t      ipPrefix;     // --ip-prefix: ... grouped by this IPv4 prefix length
+    size_t      acceptBudget; // --accept-budget: accept() calls per shard per iteration
+    size_t      backlog;      // --backlog: listen() queue length
+    // Per-connection queue limits in bytes, 0 = none (see Shard::admitOutput).
+    size_t      sendq;        // --sendq: unsent output
+    std::string sendqPolicy;  // --sendq-policy=disconnect|drop (drop: oldest broadcasts first)
+    size_t      recvq;        // --recvq: received, not yet processed input
+    std::string recvqPolicy;  // --recvq-policy=pause|disconnect
+    // Inbound flood control (see Shard::processInput).
+    size_t      floodRate;    // --flood-rate: sustained lines per second per client, 0 = off
+    size_t      floodBurst;   // --flood-burst: lines a client may run ahead of that rate
+    size_t      lineBudget;   // --line-budget: lines per client per loop iteration
+    std::string utf8;         // --utf8=any|strict (strict: drop lines that are not UTF-8)
+    ServerConfig();
+};
+
+// Apply one "--name=value" argument. Returns false and fills err if the
+// option is unknown or its value is invalid.
+bool applyConfigArg(ServerConfig &cfg, const std::string &arg, std::string &err);
+
+#endif
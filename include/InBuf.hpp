@@ -0,0 +1,42 @@
+#ifndef INBUF_HPP
+#define INBUF_HPP
+
+// Per-client input buffer. recv() writes straight into its spare room
+// (space() + commit()), complete lines are read in place and consumed by
+// moving the head forward. The newline scan resumes where the last one stopped,
+// and the unread tail is only moved to the front when room is needed, so
+// ingest costs O(bytes) however the input is split into reads and lines.
+// The scan (LineScan.hpp) also notes what the line holds: see lineFlags().
+
+#include <cstddef>
+
+class InBuf {
+    char   *_data;
+    size_t  _cap;
+    size_t  _head;   // first unconsumed byte
+    size_t  _tail;   // end of received data
+    size_t  _scan;   // [_head, _scan) holds no '\n'
+    unsigned _flags; // LINE_* seen in [_head, _scan)
+
+    InBuf(const InBuf &);
+    InBuf &operator=(const InBuf &);
+public:
+    enum { NPOS = (size_t)-1 };
+
+    InBuf();
+    ~InBuf();
+
+    size_t size() const { return _tail - _head; }
+    bool empty() const { return _tail == _head; }
+    const char *data() const { return _data + _head; }
+    // Room for at least want more bytes at the end; pointers from data() become
+    // invalid. Fill it, then commit() what was written.
+    char *space(size_t want);
+    void commit(size_t n) { _tail += n; }
+    // Offset of the next '\n' from data(), or NPOS.
+    size_t findLine();
+    unsigned lineFlags() const { return _flags; } // for the line findLine() found
+    void consume(size_t n);  // whole lines, through their '\n'
+};
+
+#endif
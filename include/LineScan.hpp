@@ -0,0 +1,28 @@
+#ifndef LINESCAN_HPP
+#define LINESCAN_HPP
+
+// Line framing and byte checks over received input, vectorized where the CPU
+// allows: AVX2 or SSE2 on x86 (picked once at startup), plain C++ elsewhere.
+// All implementations must give the same answers; tools/microbench checks that
+// before timing them.
+
+#include <cstddef>
+
+// What scanLine() saw in the bytes before the line end.
+enum {
+    LINE_NUL  = 1,  // a NUL byte
+    LINE_CR   = 2,  // a CR not followed by LF (a CR ending the range is not judged)
+    LINE_HIGH = 4   // a byte >= 0x80 (only then is UTF-8 validation needed)
+};
+
+// Offset of the first '\n' in [p, p + n), or n if there is none. ORs into
+// flags what the bytes before it contain; the caller decides what is forbidden.
+size_t scanLine(const char *p, size_t n, unsigned &flags);
+
+// Well-formed UTF-8: no overlong forms, surrogates or code points past U+10FFFF.
+bool validUtf8(const char *p, size_t n);
+
+const char *lineScanImpl();              // "avx2", "sse2" or "scalar"
+bool useLineScanImpl(const char *name);  // false if unknown or not supported here
+
+#endif
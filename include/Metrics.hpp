@@ -0,0 +1,79 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+// Counters, gauges and latency histograms. Each shard owns one ShardMetrics and
+// is its only writer; STATS and the metrics file read them from other threads.
+// Updates are relaxed atomic load+store pairs (no locked instruction, no lock),
+// reads are relaxed loads, so a snapshot is per-field consistent, not global.
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+unsigned long monoNs(); // CLOCK_MONOTONIC in nanoseconds
+
+inline unsigned long metricGet(const unsigned long &v) { return __atomic_load_n(&v, __ATOMIC_RELAXED); }
+inline void metricSet(unsigned long &v, unsigned long x) { __atomic_store_n(&v, x, __ATOMIC_RELAXED); }
+inline void metricAdd(unsigned long &v, unsigned long n) { metricSet(v, metricGet(v) + n); }
+inline void metricSub(unsigned long &v, unsigned long n) { metricSet(v, metricGet(v) - n); }
+
+// Occupancy of an object Pool (see Pool.hpp).
+struct PoolStats {
+    unsigned long inUse;
+    unsigned long peak;
+    unsigned long capacity;   // slots in allocated slabs
+    unsigned long bytes;      // memory held by the slabs
+    PoolStats() : inUse(0), peak(0), capacity(0), bytes(0) {}
+};
+
+// Log2 buckets: bucket i counts values below 2^i (and at least 2^(i-1)).
+struct Histogram {
+    enum { BUCKETS = 36 };    // up to ~34 s when the unit is ns
+    unsigned long count;
+    unsigned long sum;
+    unsigned long buckets[BUCKETS];
+
+    Histogram();
+    void add(unsigned long v);
+    void addTo(Histogram &out) const;      // out += this, reading with relaxed loads
+    unsigned long quantile(double q) const; // upper bound of the bucket holding it
+};
+
+struct ShardMetrics {
+    enum { MAX_COMMANDS = 32 };
+    // Counters.
+    unsigned long accepted;    // connections attached
+    unsigned long closed;      // connections closed
+    unsigned long rejected;    // closed at accept by --max-clients/--max-per-ip
+    unsigned long bytesIn;     // recv()
+    unsigned long bytesOut;    // sendmsg()
+    unsigned long writes;      // sendmsg() calls
+    unsigned long linesIn;     // complete lines handed to handleLine()
+    unsigned long unknown;     // lines with no matching command
+    unsigned long malformed;   // lines dropped for NUL, bare CR or (--utf8=strict) bad UTF-8
+    unsigned long throttled;   // times a client's lines were held back by --flood-rate
+    unsigned long deferred;    // times a client's lines were left for the next iteration (--line-budget)
+    unsigned long loops;       // event loop iterations
+    unsigned long waitNs;      // time spent inside the backend wait
+    unsigned long sendqDropped; // broadcast bytes dropped by --sendq-policy=drop
+    // Gauges.
+    unsigned long clients;     // connected clients
+    unsigned long sendq;       // bytes queued for all clients, not yet sent
+    unsigned long sendqPeak;   // largest single client queue seen
+    unsigned long recvq;       // bytes received from all clients, not yet processed
+    unsigned long recvqPeak;   // largest single client input buffer seen
+    unsigned long poolCapacity; // Client pool slots (clients: in use)
+    unsigned long poolBytes;    // Client pool memory
+    // Handler latency in ns, by dispatch table index (Server::commandName()).
+    Histogram     commands[MAX_COMMANDS];
+
+    ShardMetrics();
+    void addTo(ShardMetrics &out) const;   // out += this (gauges added too)
+};
+
+// Prometheus text exposition format; commands[i] names ShardMetrics::commands[i].
+std::string formatPrometheus(const std::vector<ShardMetrics> &shards,
+                             const std::vector<const char *> &commands,
+                             size_t users, const PoolStats &channels, unsigned long uptimeSec);
+
+#endif
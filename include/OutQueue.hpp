@@ -0,0 +1,51 @@
+#ifndef OUTQUEUE_HPP
+#define OUTQUEUE_HPP
+
+// Per-client output queue: a ring of buffer references. Private replies are
+// copied into the tail chunk while it has room (one allocation per few KB,
+// not per line); broadcast buffers are linked by reference. Append and
+// consume are O(1), and the unsent data is exposed as iovecs for sendmsg().
+
+#include <cstddef>
+#include <vector>
+#include <sys/uio.h>
+
+#include "SharedBuf.hpp"
+
+class OutQueue {
+    struct Entry {
+        SharedBuf *buf;
+        bool       own;  // private chunk: may still be appended to
+    };
+    std::vector<Entry> _ring;  // capacity is a power of two
+    size_t     _head;          // index of the oldest entry
+    size_t     _count;         // entries in use
+    size_t     _off;           // bytes of the oldest entry already sent
+    size_t     _bytes;         // unsent bytes in total
+    SharedBuf *_spare;         // drained private chunk kept for reuse
+
+    OutQueue(const OutQueue &);
+    OutQueue &operator=(const OutQueue &);
+    Entry &at(size_t i) { return _ring[(_head + i) & (_ring.size() - 1)]; }
+    const Entry &at(size_t i) const { return _ring[(_head + i) & (_ring.size() - 1)]; }
+    void push(SharedBuf *b, bool own);
+    void popFront();
+public:
+    enum { CHUNK = 4096 };
+
+    OutQueue();
+    ~OutQueue();
+
+    bool empty() const { return _bytes == 0; }
+    size_t size() const { return _bytes; }
+    void append(const char *data, size_t len);   // copied into the tail chunk
+    void appendShared(SharedBuf *b);              // queued by reference
+    // Describe up to max unsent buffers as iovecs; returns how many were filled.
+    int iov(struct iovec *iov, int max) const;
+    void consume(size_t n);
+    // Remove the oldest broadcast buffers not yet started until at least need
+    // bytes are gone (or none are left); private replies stay. Returns bytes removed.
+    size_t dropShared(size_t need);
+};
+
+#endif
@@ -1,19 +1,34 @@
-
 #ifndef PARSER_HPP
 #define PARSER_HPP
 
-// A tiny helper to parse IRC lines into: command + parameters (vector).
+// A tiny, allocation-free IRC line parser. Every field is a StrRef into the
+// line itself (normally the client's input buffer), so nothing is copied.
+//   [@tags SPACE] [:prefix SPACE] command *( SPACE param ) [SPACE :trailing]
+
+#include <cstddef>
+#include "StrRef.hpp"
 
-#include <string>
-#include <vector>
+// RFC 1459: at most 15 parameters; the 15th takes the rest of the line.
+struct IrcParams {
+    enum { MAX = 15 };
+    StrRef v[MAX];
+    size_t n;
+
+    IrcParams() : n(0) {}
+    size_t size() const { return n; }
+    bool empty() const { return n == 0; }
+    const StrRef &operator[](size_t i) const { return v[i]; }
+};
 
-struct ParsedLine {
-    std::string command;
-    std::vector<std::string> params;
+struct IrcMessage {
+    StrRef    tags;     // IRCv3 message tags, without the leading '@'
+    StrRef    prefix;   // source, without the leading ':'
+    StrRef    command;
+    IrcParams params;
 };
 
-// Parse one IRC line (without the trailing CRLF).
-// Handles a single trailing parameter introduced by ':' per RFC-style.
-ParsedLine parseIrcLine(const std::string &line);
+// Parse one IRC line; a trailing CR/LF is ignored. The trailing parameter keeps
+// its spaces exactly as sent. Returns false if there is no command.
+bool parseIrcLine(const char *line, size_t len, IrcMessage &out);
 
 #endif
@@ -0,0 +1,37 @@
+#ifndef POLLER_HPP
+#define POLLER_HPP
+
+// Event backend under Server::run(). Every backend reports readiness with the
+// poll() bits (POLLIN/POLLOUT/POLLERR/POLLHUP) and only for fds that are ready,
+// so the loop costs O(ready fds) per wakeup wherever the backend allows it.
+
+#include <string>
+#include <vector>
+#include <poll.h>
+
+struct PollEvent {
+    int   fd;
+    short revents;
+};
+
+class Poller {
+public:
+    virtual ~Poller() {}
+    virtual const char *name() const = 0;
+    // Interest uses the same POLLIN/POLLOUT bits as struct pollfd::events.
+    virtual bool add(int fd, short events) = 0;
+    virtual bool modify(int fd, short events) = 0;
+    virtual void remove(int fd) = 0;
+    // Block up to timeoutMs (-1 = forever); `out` receives ready fds only.
+    // Returns the number of events, or -1 with errno set.
+    virtual int wait(int timeoutMs, std::vector<PollEvent> &out) = 0;
+    // Edge-triggered backends only report transitions: callers must drain
+    // reads and writes until the kernel pushes back.
+    virtual bool edgeTriggered() const { return false; }
+
+    // kind: "auto" (best available), "poll", "epoll" or "epoll-et".
+    // Returns 0 if the backend is unknown or not available on this platform.
+    static Poller *create(const std::string &kind);
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef POOL_HPP
+#define POOL_HPP
+
+// Fixed-size object pool: objects live in slabs of kPerSlab slots and freed
+// slots go on a free list, so create() and destroy() are O(1) and never touch
+// the global allocator once the pool has grown to its working size. The most
+// recently freed slot is reused first, which keeps live objects close together.
+// Not thread-safe: each pool belongs to one shard, or is used under the state lock.
+
+#include <vector>
+#include <new>
+#include <cstddef>
+
+#include "Metrics.hpp"
+
+template <class T>
+class Pool {
+    union Slot {
+        Slot       *next;                 // while free
+        char        bytes[sizeof(T)];     // while in use
+        long double alignLd;              // alignment only
+        void       *alignPtr;
+    };
+    enum { kPerSlab = 64 };
+    std::vector<Slot *> _slabs;
+    Slot  *_free;
+    size_t _inUse;
+    size_t _peak;
+
+    Pool(const Pool &);
+    Pool &operator=(const Pool &);
+
+    void *take() {
+        if (!_free) {
+            Slot *slab = static_cast<Slot *>(::operator new(sizeof(Slot) * kPerSlab));
+            _slabs.push_back(slab);
+            for (size_t i = kPerSlab; i-- > 0; ) {
+                slab[i].next = _free;
+                _free = &slab[i];
+            }
+        }
+        Slot *s = _free;
+        _free = s->next;
+        if (++_inUse > _peak) _peak = _inUse;
+        return s;
+    }
+public:
+    Pool() : _free(0), _inUse(0), _peak(0) {}
+    // Objects must all have been destroyed; only the slabs are released.
+    ~Pool() {
+        for (size_t i = 0; i < _slabs.size(); ++i) ::operator delete(_slabs[i]);
+    }
+
+    template <class A>
+    T *create(const A &a) { return new (take()) T(a); }
+    template <class A, class B>
+    T *create(const A &a, const B &b) { return new (take()) T(a, b); }
+
+    void destroy(T *p) {
+        if (!p) return;
+        p->~T();
+        Slot *s = reinterpret_cast<Slot *>(p);
+        s->next = _free;
+        _free = s;
+        --_inUse;
+    }
+
+    PoolStats stats() const {
+        PoolStats st;
+        st.inUse = _inUse;
+        st.peak = _peak;
+        st.capacity = _slabs.size() * kPerSlab;
+        st.bytes = st.capacity * sizeof(Slot);
+        return st;
+    }
+};
+
+#endif
@@ -10,6 +10,8 @@
 namespace RPL {
     // 001 Welcome
     std::string welcome(const std::string &server, const std::string &nick);
+    // 005 isupport
+    std::string isupport(const std::string &server, const std::string &nick, const std::string &tokens);
     // 332 topic
     std::string topic(const std::string &server, const std::string &nick, const std::string &chan, const std::string &topic);
     // 331 no topic
@@ -18,6 +20,15 @@ namespace RPL {
     std::string namreply(const std::string &server, const std::string &nick, const std::string &chan, const std::string &namelist);
     // 366 end of names
     std::string endofnames(const std::string &server, const std::string &nick, const std::string &chan);
+    // 311 / 319 / 318 whois
+    std::string whoisuser(const std::string &server, const std::string &nick, const std::string &target, const std::string &user, const std::string &host, const std::string &real);
+    std::string whoischannels(const std::string &server, const std::string &nick, const std::string &target, const std::string &chans);
+    std::string endofwhois(const std::string &server, const std::string &nick, const std::string &target);
+    // 212 / 242 / 249 / 219 stats
+    std::string statscommands(const std::string &server, const std::string &nick, const std::string &cmd, unsigned long count);
+    std::string statsuptime(const std::string &server, const std::string &nick, unsigned long seconds);
+    std::string statsdebug(const std::string &server, const std::string &nick, const std::string &text);
+    std::string endofstats(const std::string &server, const std::string &nick, char query);
     // 341 inviting
     std::string inviting(const std::string &server, const std::string &nick, const std::string &target, const std::string &chan);
 }
@@ -35,6 +46,7 @@ namespace ERR {
     std::string badchannelkey(const std::string &server, const std::string &nick, const std::string &chan);
     std::string inviteonlychan(const std::string &server, const std::string &nick, const std::string &chan);
     std::string channelisfull(const std::string &server, const std::string &nick, const std::string &chan);
+    std::string toomanytargets(const std::string &server, const std::string &nick, const std::string &target);
 }
 
 #endif
@@ -2,10 +2,11 @@
 #ifndef SERVER_HPP
 #define SERVER_HPP
 
-// The Server orchestrates sockets, poll(), clients, channels and command handling.
+// The Server owns the shared IRC state (nicks, channels) and the shards (event
+// loops) serving clients. Shared state is only touched with the state lock
+// held: a shard takes it once per loop iteration to run commands.
 
 #include <string>
-#include <map>
 #include <vector>
 #include <set>
 #include <sys/types.h>
@@ -16,49 +17,101 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <poll.h>
+#include <pthread.h>
 
 #include "Client.hpp"
 #include "Channel.hpp"
+#include "Config.hpp"
+#include "CaseMap.hpp"
+#include "Metrics.hpp"
+#include "Capture.hpp"
+#include "Pool.hpp"
+#include "Admission.hpp"
+
+class Shard;
+struct Delivery;
 
 class Server {
     std::string _serverName;        // used in replies prefix
     std::string _password;          // PASS <password>
-    int         _listenFd;          // listening socket
-    std::vector<struct pollfd> _pfds; // single poll() vector (only one poll used globally)
-    std::map<int, Client*> _clients;     // by fd
-    std::map<std::string, int> _nickToFd; // nick to fd
-    std::map<std::string, Channel*> _channels; // by channel name
+    ServerConfig _cfg;              // optional knobs from the command line
+    CaseMapping _casemap;
+    std::string _isupport;          // RPL_ISUPPORT tokens
+    unsigned long _startNs;         // monoNs() when run() was called
+    Capture    *_capture;           // 0 unless --capture
+    Admission   _admission;         // connection limits (own lock)
+    std::vector<Shard*> _shards;    // event loops; shard 0 runs on the main thread
+    // Everything below is guarded by _lock.
+    pthread_mutex_t _lock;
+    Shard      *_current;           // shard whose thread holds _lock
+    std::vector<Shard*> _owner;     // fd -> shard serving it (0 if none)
+    std::vector<Delivery*> _outbox; // per shard: output for its clients, posted by unlock()
+    unsigned long _nextId;          // Client::id() source
+    std::vector<unsigned> _seen;    // fd -> epoch it was last sent to (fan-out dedup)
+    unsigned    _epoch;
+    CaseTable<int> _nicks;          // nick -> fd
+    CaseTable<Channel*> _channels;  // by channel name
+    Pool<Channel> _channelPool;     // where they live
 public:
-    Server(const std::string &serverName, const std::string &password);
+    Server(const std::string &serverName, const std::string &password,
+           const ServerConfig &cfg = ServerConfig());
     ~Server();
 
-    bool start(unsigned short port); // create/bind/listen
-    void run();                      // main loop with a single poll()
+    bool start(unsigned short port); // create/bind/listen, one listener per shard
+    void run();                      // run the shards' event loops (does not return)
     void stop();                     // cleanup sockets
 
+    // Used by shards around everything that touches shared state.
+    void lock(Shard *sh);
+    void unlock();                   // also posts batched output to other shards
+    void attachClient(Shard *sh, Client *c);
+
+    // Metrics: per-shard snapshot (any thread, relaxed reads) and the periodic file.
+    void collectMetrics(std::vector<ShardMetrics> &out) const;
+    unsigned long uptimeSec() const;
+    void dumpMetrics(Shard *sh);     // takes the lock to render, writes without it
+    Capture *capture() const { return _capture; }
+    Admission &admission() { return _admission; }
+
     // Helpers for client management
-    void handleListenEvent(short revents);
-    void handleClientEvent(size_t i); // i is index in _pfds
-    void disconnectClient(int fd, const std::string &reason);
+    void disconnectClient(int fd, const std::string &reason); // fd closed after the iteration
 
     // Sending helpers
     void sendToClient(int fd, const std::string &msg); // enqueue + enable POLLOUT
+    // Same, queues buf by reference; broadcast output may go first under --sendq-policy=drop.
+    void sendShared(int fd, SharedBuf *buf, bool broadcast = true);
     void sendToChannel(const std::string &chan, int fromFd, const std::string &line);
+    // Once to every user sharing a channel with c (and to c itself if toSelf).
+    void sendToPeers(Client *c, const std::string &line, bool toSelf);
+    // De-duplicated fan-out: after beginFanout(), markSeen() is true once per fd.
+    void beginFanout();
+    bool markSeen(int fd);            // false if fd already got something in this fan-out
+    // Members not yet marked, marking them; except (a member fd) is skipped unmarked.
+    void sendToMembers(Channel *ch, SharedBuf *buf, int except = -1);
 
     // State access
     Client *getClient(int fd);
-    Client *getClientByNick(const std::string &nick);
+    Client *getClientByNick(const StrRef &nick);
+    bool nickInUse(const StrRef &nick);
+    void setNick(Client *c, const std::string &nick); // also re-keys the nick table
     Channel *getOrCreateChannel(const std::string &name);
-    Channel *findChannel(const std::string &name);
+    Channel *findChannel(const StrRef &name);
     void removeChannelIfEmpty(const std::string &name);
+    // Membership changes go through these so Client::channels() stays in sync.
+    void joinChannel(Channel *ch, Client *c);
+    void partChannel(Channel *ch, Client *c);
 
     // Command dispatcher
-    void handleLine(int fd, const std::string &line);
+    void handleLine(int fd, const char *line, size_t len); // one line, without its '\n' 
+    static size_t commandCount();                           // dispatch table, for metrics
+    static const char *commandName(size_t i);
     const std::string &serverName() const { return _serverName; }
     const std::string &password() const { return _password; }
-    std::map<int, Client*> &clients() { return _clients; }
-    std::map<std::string, Channel*> &channels() { return _channels; }
-    std::map<std::string, int> &nickToFd() { return _nickToFd; }
+    const ServerConfig &config() const { return _cfg; }
+    const std::string &isupport() const { return _isupport; }
+    size_t userCount() const { return _nicks.size(); }
+    size_t channelCount() const { return _channels.size(); }
+    PoolStats channelPoolStats() const { return _channelPool.stats(); }
 };
 
 #endif
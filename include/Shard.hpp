@@ -0,0 +1,126 @@
+#ifndef SHARD_HPP
+#define SHARD_HPP
+
+// A Shard is one event loop: its own listening socket (SO_REUSEPORT when there
+// are several), event backend and set of clients. Socket I/O and the output
+// queues of its clients are only ever touched by the shard's own thread.
+//
+// Nicks and channels live in Server and are only touched with the state lock
+// held. Output for a client of another shard is not written into that
+// client's queue but posted to the owning shard's inbox: a lock-free list of
+// Deliveries, one per (sending iteration, destination shard), so a broadcast
+// spanning shards costs one push per shard rather than one lock per member.
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <pthread.h>
+
+#include "ClientTable.hpp"
+#include "Poller.hpp"
+#include "Metrics.hpp"
+#include "Pool.hpp"
+#include "Client.hpp"
+#include "TimerWheel.hpp"
+
+class Server;
+class SharedBuf;
+
+// Output for clients of one shard, produced while another shard held the lock.
+struct Delivery {
+    struct Item {
+        int           fd;
+        unsigned long id;    // Client::id(), so a reused fd never gets stale output
+        SharedBuf    *buf;   // one reference owned by the item
+        bool          broadcast; // false: a private reply, which --sendq-policy=drop keeps
+    };
+    Delivery         *next;
+    std::vector<Item> items;
+    Delivery() : next(0) {}
+};
+
+class Shard {
+    enum { TICK_MS = 100 };         // timer resolution
+    enum { READ_CHUNK = 4096 };     // bytes asked of one recv()
+    Server     &_srv;
+    size_t      _index;
+    int         _listenFd;
+    int         _wake[2];           // pipe: written when the inbox goes non-empty
+    Poller     *_poller;
+    std::vector<PollEvent> _events; // ready fds of the current iteration
+    ClientTable _clients;           // this shard's clients, by fd
+    Pool<Client> _clientPool;       // where they live
+    std::vector<int> _closing;      // disconnected this iteration, closed by reapClosed()
+    // Collected without the lock, acted upon with it (see loop()).
+    std::vector<std::pair<int, unsigned> > _accepted; // fd, source address
+    bool        _acceptMore;        // accept budget ran out with connections left
+    std::vector<int> _readable;     // clients with lines to run this iteration
+    std::vector<int> _pending;      // ... and the next one (--line-budget ran out)
+    std::vector<std::pair<int, const char *> > _dead;
+    std::vector<int> _dirty;        // clients with output to write at the end of the iteration
+    Delivery   *_inbox;             // pushed by any thread, drained by ours
+    ShardMetrics _metrics;          // written by our thread only
+    std::string _captured;          // --capture records of this iteration
+    TimerWheel  _wheel;             // client timeouts, and shard 0's metrics file
+    TimerWheel::Timer _metricsTimer;
+    std::vector<TimerWheel::Timer *> _expired;
+    unsigned long _nowMs;           // monotonic, taken after each wait
+    pthread_t   _thread;
+
+    Shard(const Shard &);
+    Shard &operator=(const Shard &);
+
+    void handleListenEvent(short revents);
+    void handleClientEvent(int fd, short revents);
+    void drainWake();
+    void attachAccepted();
+    void processInput(int fd);
+    void drainInbox();
+    void reapClosed();
+    void updatePoolMetrics();
+    bool admitOutput(Client *c, size_t len);
+    void runTimers();
+    void checkTimeouts(Client *c);
+    void queueInput(Client *c);
+    void markDirty(Client *c);
+    void flushDirty();
+    static void *threadMain(void *arg);
+public:
+    Shard(Server &srv, size_t index);
+    ~Shard();
+
+    size_t index() const { return _index; }
+    bool start(unsigned short port, bool reusePort, const std::string &backend);
+    void stop();
+    bool spawn();                    // run loop() on a new thread
+    void loop();                     // wait, read, dispatch (locked), deliver, reap
+
+    // Any thread holding the state lock, for an fd that Server::_owner maps to
+    // this shard: the owner only resizes the table (attachAccepted()) and marks
+    // clients closing (detach()) under that lock, and only frees clients whose
+    // _owner entry was cleared under it. Its unlocked writes (interest bits,
+    // reapClosed()) never touch what such a lookup reads.
+    Client *client(int fd) const { return _clients.get(fd); }
+
+    // Owner thread only.
+    void setInterest(int fd, short events); // backend call only when it changes
+    void flushClient(Client *c);            // write queued output until empty or EAGAIN
+    void enqueue(Client *c, const std::string &s); // queue output, written by flushDirty()
+    // Same, by reference; a private reply (!broadcast) is copied so it is never dropped.
+    void enqueue(Client *c, SharedBuf *buf, bool broadcast = true);
+    // POLLIN unless reads are paused (--recvq); POLLOUT while output waits for
+    // the socket to become writable again.
+    void updateInterest(Client *c) {
+        setInterest(c->fd(), (short)((c->readPaused() ? 0 : POLLIN)
+                                     | (c->hasOut() && !c->writable() ? POLLOUT : 0)));
+    }
+    void detach(int fd);                    // stop watching; fd closed after the iteration
+
+    ShardMetrics &metrics() { return _metrics; }
+
+    // Any thread.
+    void post(Delivery *d);
+    const ShardMetrics &metrics() const { return _metrics; } // read with metricGet()
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef SHAREDBUF_HPP
+#define SHAREDBUF_HPP
+
+// Reference-counted message bytes. A broadcast serializes its line once into
+// a SharedBuf and every recipient queues a pointer to it; the bytes are freed
+// when the last output queue has sent them. Once shared, a buffer is immutable.
+// OutQueue also uses unshared buffers as append-only chunks (see append()).
+// The reference count is atomic: shards release buffers other shards created.
+
+#include <cstddef>
+
+class SharedBuf {
+    int    _refs;
+    size_t _size;
+    size_t _cap;
+    // Bytes follow the object in the same allocation (see alloc()).
+    SharedBuf(size_t cap) : _refs(1), _size(0), _cap(cap) {}
+    ~SharedBuf() {}
+    SharedBuf(const SharedBuf &);
+    SharedBuf &operator=(const SharedBuf &);
+    static SharedBuf *alloc(size_t cap);
+    char *bytes() { return reinterpret_cast<char *>(this + 1); }
+public:
+    // New buffer holding a copy of data[0..len), with one reference owned by the caller.
+    static SharedBuf *create(const char *data, size_t len);
+    // Empty buffer with room for cap bytes, for append().
+    static SharedBuf *chunk(size_t cap);
+
+    const char *data() const { return reinterpret_cast<const char *>(this + 1); }
+    size_t size() const { return _size; }
+    size_t spare() const { return _cap - _size; }
+    bool unique() const { return *const_cast<volatile const int *>(&_refs) == 1; }
+    // Only while unique(): add bytes (len <= spare()) or start over empty.
+    void append(const char *data, size_t len);
+    void reset() { _size = 0; }
+
+    void retain() { __sync_add_and_fetch(&_refs, 1); }
+    void release();
+};
+
+#endif
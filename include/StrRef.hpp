@@ -0,0 +1,38 @@
+#ifndef STRREF_HPP
+#define STRREF_HPP
+
+// A non-owning view of bytes (pointer + length), used to hand pieces of a
+// received line around without copying. Valid only while the bytes it points
+// into are untouched — for a parsed line, until handleLine() returns.
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+struct StrRef {
+    const char *data;
+    size_t      len;
+
+    StrRef() : data(""), len(0) {}
+    StrRef(const char *d, size_t n) : data(d), len(n) {}
+    StrRef(const char *s) : data(s), len(std::strlen(s)) {}
+    StrRef(const std::string &s) : data(s.data()), len(s.size()) {}
+
+    bool empty() const { return len == 0; }
+    size_t size() const { return len; }
+    char operator[](size_t i) const { return data[i]; }
+    // Copy out only where an owned string is really needed.
+    std::string str() const { return std::string(data, len); }
+    operator std::string() const { return str(); }
+};
+
+inline bool operator==(const StrRef &a, const StrRef &b) {
+    return a.len == b.len && std::memcmp(a.data, b.data, a.len) == 0;
+}
+inline bool operator!=(const StrRef &a, const StrRef &b) { return !(a == b); }
+inline bool operator==(const StrRef &a, const std::string &b) { return a == StrRef(b); }
+inline bool operator==(const std::string &a, const StrRef &b) { return StrRef(a) == b; }
+inline bool operator!=(const StrRef &a, const std::string &b) { return !(a == b); }
+inline bool operator!=(const std::string &a, const StrRef &b) { return !(a == b); }
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef TIMERWHEEL_HPP
+#define TIMERWHEEL_HPP
+
+// Hierarchical timing wheel: LEVELS wheels of SLOTS slots. A timer due within
+// SLOTS ticks sits in level 0 at its exact tick; further ones sit in a coarser
+// level, and whenever level 0 wraps around the next slot of level 1 is moved
+// down (and so on up the levels). Timers are intrusive doubly-linked nodes, so
+// schedule() and cancel() are O(1) and advance() costs O(ticks + expired).
+// Each shard owns one wheel; nothing here is thread-safe.
+
+#include <vector>
+#include <cstddef>
+
+class TimerWheel {
+public:
+    struct Timer {
+        Timer        *next;
+        Timer        *prev;   // 0 while not scheduled
+        unsigned long due;    // tick
+        size_t        slot;   // level * SLOTS + index, while pending
+        void         *owner;  // for the caller; the wheel never looks at it
+        Timer() : next(0), prev(0), due(0), slot(0), owner(0) {}
+        bool pending() const { return prev != 0; }
+    };
+    enum { BITS = 6, SLOTS = 1 << BITS, LEVELS = 4 };
+
+    explicit TimerWheel(unsigned long tickMs);
+    void start(unsigned long nowMs);                  // time of the first tick
+    void schedule(Timer *t, unsigned long atMs);      // (re)arm; never fires early
+    void cancel(Timer *t);                            // no-op if not pending
+    // Fire everything due by nowMs: appended to out, no longer pending.
+    void advance(unsigned long nowMs, std::vector<Timer *> &out);
+    // How long the event loop may sleep before advance() has work: -1 if no
+    // timer is pending, otherwise at most one level-0 turn.
+    int timeoutMs(unsigned long nowMs) const;
+    size_t size() const { return _count; }
+
+private:
+    Timer         _slots[LEVELS][SLOTS]; // list heads (circular, self-linked when empty)
+    unsigned long _occupied[LEVELS];     // bit i: slot i is non-empty
+    unsigned long _tick;                 // next tick to run; earlier ones have fired
+    unsigned long _tickMs;
+    size_t        _count;
+
+    TimerWheel(const TimerWheel &);
+    TimerWheel &operator=(const TimerWheel &);
+
+    void file(Timer *t);
+    void unlink(Timer *t);
+    bool cascade(size_t level);          // true if the level above must cascade too
+};
+
+#endif
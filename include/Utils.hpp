@@ -5,7 +5,11 @@
 #include <string>
 #include <vector>
 
-std::string toLower(const std::string &s);
+// Longest nick accepted by NICK (RPL_NAMREPLY splitting relies on it).
+const size_t NICKLEN = 30;
+// Most comma-separated targets one PRIVMSG/NOTICE may name (TARGMAX).
+const size_t MAXTARGETS = 20;
+
 std::string trimCRLF(const std::string &s);
 bool isValidNick(const std::string &nick);
 std::vector<std::string> split(const std::string &s, char delim);
@@ -0,0 +1,102 @@
+#include "Admission.hpp"
+
+Admission::Admission(size_t maxClients, size_t maxPerSource, size_t prefixLen)
+: _slots(64), _used(0), _total(0), _maxClients(maxClients), _maxPerSource(maxPerSource),
+  _mask(prefixLen >= 32 ? 0xffffffffu : ~(0xffffffffu >> prefixLen)) {
+    pthread_mutex_init(&_lock, 0);
+    for (size_t i = 0; i < _slots.size(); ++i) _slots[i].key = _slots[i].count = 0;
+}
+
+Admission::~Admission() {
+    pthread_mutex_destroy(&_lock);
+}
+
+size_t Admission::home(unsigned key) const {
+    // Upper half of a 64-bit multiplicative hash: every key bit reaches it, so
+    // /24 or /16 keys (low bits all zero) still spread.
+    return (size_t)(((unsigned long)key * 0x9E3779B97F4A7C15UL) >> 32) & (_slots.size() - 1);
+}
+
+Admission::Slot *Admission::find(unsigned key) {
+    for (size_t i = home(key); _slots[i].count; i = (i + 1) & (_slots.size() - 1))
+        if (_slots[i].key == key) return &_slots[i];
+    return 0;
+}
+
+void Admission::grow() {
+    std::vector<Slot> old;
+    old.swap(_slots);
+    Slot empty;
+    empty.key = 0;
+    empty.count = 0;
+    _slots.assign(old.size() * 2, empty);
+    for (size_t i = 0; i < old.size(); ++i) {
+        if (!old[i].count) continue;
+        size_t j = home(old[i].key);
+        while (_slots[j].count) j = (j + 1) & (_slots.size() - 1);
+        _slots[j] = old[i];
+    }
+}
+
+void Admission::erase(size_t i) {
+    // Backward-shift deletion: pull later entries of the probe run into the
+    // hole so lookups never need tombstones.
+    size_t mask = _slots.size() - 1;
+    for (size_t j = (i + 1) & mask; _slots[j].count; j = (j + 1) & mask) {
+        size_t h = home(_slots[j].key);
+        if (((j - h) & mask) >= ((j - i) & mask)) {
+            _slots[i] = _slots[j];
+            i = j;
+        }
+    }
+    _slots[i].count = 0;
+    --_used;
+}
+
+Admission::Verdict Admission::admit(unsigned ip) {
+    unsigned key = ip & _mask;
+    pthread_mutex_lock(&_lock);
+    Verdict v = OK;
+    Slot *s = find(key);
+    if (_maxClients && _total >= _maxClients) v = SERVER_FULL;
+    else if (_maxPerSource && s && s->count >= _maxPerSource) v = SOURCE_FULL;
+    else {
+        if (!s) {
+            if ((_used + 1) * 2 > _slots.size()) grow();
+            size_t i = home(key);
+            while (_slots[i].count) i = (i + 1) & (_slots.size() - 1);
+            s = &_slots[i];
+            s->key = key;
+            s->count = 0;
+            ++_used;
+        }
+        ++s->count;
+        ++_total;
+    }
+    pthread_mutex_unlock(&_lock);
+    return v;
+}
+
+void Admission::release(unsigned ip) {
+    pthread_mutex_lock(&_lock);
+    Slot *s = find(ip & _mask);
+    if (s) {
+        --_total;
+        if (--s->count == 0) erase(s - &_slots[0]);
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+size_t Admission::total() {
+    pthread_mutex_lock(&_lock);
+    size_t n = _total;
+    pthread_mutex_unlock(&_lock);
+    return n;
+}
+
+size_t Admission::sources() {
+    pthread_mutex_lock(&_lock);
+    size_t n = _used;
+    pthread_mutex_unlock(&_lock);
+    return n;
+}
@@ -0,0 +1,49 @@
+
+#include "Capture.hpp"
+#include "Metrics.hpp"
+
+const char Capture::kMagic[9] = "IRCCAP1\n";
+
+namespace {
+
+void putLE(std::string &out, unsigned long v, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) out += (char)((v >> (8 * i)) & 0xff);
+}
+
+} // namespace
+
+Capture::Capture() : _file(0), _start(0) {
+    pthread_mutex_init(&_lock, 0);
+}
+
+Capture::~Capture() {
+    if (_file) std::fclose(_file);
+    pthread_mutex_destroy(&_lock);
+}
+
+bool Capture::open(const std::string &path) {
+    _file = std::fopen(path.c_str(), "wb");
+    if (!_file) { std::perror(path.c_str()); return false; }
+    _start = monoNs();
+    if (std::fwrite(kMagic, 1, 8, _file) != 8) { std::perror(path.c_str()); return false; }
+    std::fflush(_file);
+    return true;
+}
+
+void Capture::record(std::string &out, unsigned long conn, Type type, const char *data, size_t len) const {
+    putLE(out, monoNs() - _start, 8);
+    putLE(out, conn, 8);
+    out += (char)type;
+    putLE(out, len, 4);
+    if (len) out.append(data, len);
+}
+
+void Capture::write(std::string &batch) {
+    if (batch.empty()) return;
+    pthread_mutex_lock(&_lock);
+    // Flushed every batch: a capture is mostly wanted after something went wrong.
+    if (std::fwrite(batch.data(), 1, batch.size(), _file) != batch.size() || std::fflush(_file) != 0)
+        std::perror("capture");
+    pthread_mutex_unlock(&_lock);
+    batch.clear();
+}
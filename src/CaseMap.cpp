@@ -0,0 +1,64 @@
+
+#include "CaseMap.hpp"
+#include <cstring>
+#include <stdint.h>
+
+namespace {
+
+const uint64_t kOnes = 0x0101010101010101ULL;
+const uint64_t kHigh = 0x8080808080808080ULL;
+
+// Lower-cases the eight bytes of x at once (SWAR): a byte in ['A', last] gets
+// 0x20 added, which for rfc1459 (last = '^') also maps []\^ onto {}|~. Each
+// 7-bit byte plus a bias sets its top bit iff it is >= the bound; bytes >= 0x80
+// are left alone.
+inline uint64_t fold8(uint64_t x, char last) {
+    uint64_t low = x & ~kHigh;
+    uint64_t geA = low + kOnes * (0x80 - 'A');
+    uint64_t gtLast = low + kOnes * (0x80 - (last + 1));
+    uint64_t in = geA & ~gtLast & ~x & kHigh;
+    return x | (in >> 2);
+}
+
+inline char lastFolded(CaseMapping m) { return m == CASEMAP_ASCII ? 'Z' : '^'; }
+
+inline uint64_t load(const char *p, size_t n) {
+    // n <= 8; missing bytes read as zero.
+    uint64_t w = 0;
+    std::memcpy(&w, p, n);
+    return w;
+}
+
+inline uint64_t load8(const char *p) {
+    uint64_t w;
+    std::memcpy(&w, p, 8);
+    return w;
+}
+
+} // namespace
+
+const char *caseMappingName(CaseMapping m) {
+    return m == CASEMAP_ASCII ? "ascii" : "rfc1459";
+}
+
+size_t caseHash(CaseMapping m, const char *s, size_t n) {
+    char last = lastFolded(m);
+    uint64_t h = 0xcbf29ce484222325ULL ^ n;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        h = (h ^ fold8(load8(s + i), last)) * 0x100000001b3ULL;
+    if (i < n)
+        h = (h ^ fold8(load(s + i, n - i), last)) * 0x100000001b3ULL;
+    h ^= h >> 29;
+    return (size_t)h;
+}
+
+bool caseEqual(CaseMapping m, const char *a, const char *b, size_t n) {
+    char last = lastFolded(m);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        if (fold8(load8(a + i), last) != fold8(load8(b + i), last)) return false;
+    if (i < n)
+        return fold8(load(a + i, n - i), last) == fold8(load(b + i, n - i), last);
+    return true;
+}
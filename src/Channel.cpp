@@ -1,21 +1,120 @@
 
 #include "Channel.hpp"
 
-Channel::Channel(const std::string &name)
+Channel::Channel(const std::string &name, size_t namesRoom)
 : _name(name), _topic(""), _inviteOnly(false), _topicOpOnly(false),
-  _hasKey(false), _key(""), _hasLimit(false), _limit(0) {}
-
-bool Channel::isMember(int fd) const { return _members.count(fd) != 0; }
-bool Channel::isOperator(int fd) const { return _operators.count(fd) != 0; }
-bool Channel::isInvited(int fd) const { return _invited.count(fd) != 0; }
-
-void Channel::addMember(int fd) { _members.insert(fd); }
-void Channel::removeMember(int fd) {
-    _members.erase(fd);
-    _operators.erase(fd);
-    _invited.erase(fd);
-}
-void Channel::addOperator(int fd) { _operators.insert(fd); }
-void Channel::removeOperator(int fd) { _operators.erase(fd); }
-void Channel::addInvite(int fd) { _invited.insert(fd); }
-void Channel::clearInvite(int fd) { _invited.erase(fd); }
+  _hasKey(false), _key(""), _hasLimit(false), _limit(0), _namesRoom(namesRoom) {}
+
+size_t Channel::find(int fd) const {
+    size_t lo = 0, hi = _members.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (_members[mid].fd < fd) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+bool Channel::isMember(int fd) const {
+    size_t i = find(fd);
+    return i < _members.size() && _members[i].fd == fd;
+}
+bool Channel::isOperator(int fd) const {
+    size_t i = find(fd);
+    return i < _members.size() && _members[i].fd == fd && (_members[i].flags & Member::OP);
+}
+bool Channel::isInvited(int fd) const {
+    for (size_t i = 0; i < _invited.size(); ++i)
+        if (_invited[i] == fd) return true;
+    return false;
+}
+
+namespace {
+
+std::string nameEntry(const Member &m, const std::string &nick) {
+    return (m.flags & Member::OP) ? "@" + nick : nick;
+}
+
+// Position of the space-separated word w in s, or npos.
+size_t findWord(const std::string &s, const std::string &w) {
+    size_t pos = 0;
+    while ((pos = s.find(w, pos)) != std::string::npos) {
+        size_t end = pos + w.size();
+        if ((pos == 0 || s[pos - 1] == ' ') && (end == s.size() || s[end] == ' '))
+            return pos;
+        pos = end;
+    }
+    return std::string::npos;
+}
+
+} // namespace
+
+void Channel::namesAdd(Member &m, const std::string &nick) {
+    // First piece with room, so pieces emptied by parts get refilled.
+    std::string e = nameEntry(m, nick);
+    size_t i = 0;
+    while (i < _names.size() && !_names[i].empty() && _names[i].size() + 1 + e.size() > _namesRoom)
+        ++i;
+    if (i == _names.size()) _names.push_back(std::string());
+    if (!_names[i].empty()) _names[i] += ' ';
+    _names[i] += e;
+    m.chunk = i;
+}
+
+void Channel::namesRemove(const Member &m, const std::string &nick) {
+    std::string &s = _names[m.chunk];
+    std::string e = nameEntry(m, nick);
+    size_t pos = findWord(s, e);
+    if (pos == std::string::npos) return;
+    if (pos > 0) s.erase(pos - 1, e.size() + 1);
+    else s.erase(0, e.size() < s.size() ? e.size() + 1 : e.size());
+    while (!_names.empty() && _names.back().empty()) _names.pop_back();
+}
+
+void Channel::addMember(int fd, const std::string &nick) {
+    size_t i = find(fd);
+    if (i < _members.size() && _members[i].fd == fd) return;
+    Member m;
+    m.fd = fd;
+    m.flags = 0;
+    namesAdd(m, nick);
+    _members.insert(_members.begin() + i, m);
+}
+void Channel::removeMember(int fd, const std::string &nick) {
+    size_t i = find(fd);
+    if (i < _members.size() && _members[i].fd == fd) {
+        namesRemove(_members[i], nick);
+        _members.erase(_members.begin() + i);
+    }
+    clearInvite(fd);
+}
+
+void Channel::setFlag(int fd, const std::string &nick, unsigned char flag, bool on) {
+    size_t i = find(fd);
+    if (i == _members.size() || _members[i].fd != fd) return;
+    Member &m = _members[i];
+    if (((m.flags & flag) != 0) == on) return;
+    namesRemove(m, nick);
+    if (on) m.flags |= flag;
+    else m.flags &= ~flag;
+    namesAdd(m, nick);
+}
+void Channel::addOperator(int fd, const std::string &nick) { setFlag(fd, nick, Member::OP, true); }
+void Channel::removeOperator(int fd, const std::string &nick) { setFlag(fd, nick, Member::OP, false); }
+
+void Channel::renameMember(int fd, const std::string &from, const std::string &to) {
+    size_t i = find(fd);
+    if (i == _members.size() || _members[i].fd != fd) return;
+    namesRemove(_members[i], from);
+    namesAdd(_members[i], to);
+}
+
+void Channel::addInvite(int fd) {
+    if (isInvited(fd)) return;
+    if (_invited.size() == kMaxInvites) _invited.erase(_invited.begin());
+    _invited.push_back(fd);
+}
+void Channel::clearInvite(int fd) {
+    for (size_t i = 0; i < _invited.size(); ++i)
+        if (_invited[i] == fd) { _invited.erase(_invited.begin() + i); return; }
+}
@@ -1,6 +1,42 @@
 
 #include "Client.hpp"
+#include <cstdio>
 
 Client::Client(int fd)
-: _fd(fd), _inbuf(""), _outbuf(""), _nick(""), _user(""), _realname(""),
-  _passOk(false), _registered(false) {}
+: _fd(fd), _id(0), _nick(""), _user(""), _realname(""),
+  _host("localhost"), _ip(0), _passOk(false), _registered(false),
+  _readPaused(false), _evicted(false), _inputQueued(false), _throttled(false),
+  _writable(false), _flushQueued(false),
+  _connectedMs(0), _lastInputMs(0), _lastActiveMs(0), _pingSentMs(0),
+  _floodClockUs(0) {
+    _timer.owner = this;
+    _resumeTimer.owner = this;
+    updatePrefix();
+}
+
+void Client::updatePrefix() {
+    _prefix = ":";
+    _prefix += _nick.empty()? "*": _nick;
+    _prefix += "!";
+    _prefix += _user.empty()? "user": _user;
+    _prefix += "@";
+    _prefix += _host;
+    _prefix += " ";
+}
+
+void Client::setAddress(unsigned ip) {
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "%u.%u.%u.%u", ip >> 24, (ip >> 16) & 255, (ip >> 8) & 255, ip & 255);
+    _ip = ip;
+    setHost(buf);
+}
+
+void Client::removeChannel(Channel *ch) {
+    // Users sit in a handful of channels: a linear scan beats any index here.
+    for (size_t i = 0; i < _channels.size(); ++i) {
+        if (_channels[i] == ch) {
+            _channels.erase(_channels.begin() + i);
+            return;
+        }
+    }
+}
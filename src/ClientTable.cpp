@@ -0,0 +1,46 @@
+#include "ClientTable.hpp"
+
+void ClientTable::insert(int fd, Client *c, short interest) {
+    if ((size_t)fd >= _slots.size()) {
+        Slot empty;
+        empty.client = 0;
+        empty.dense = -1;
+        empty.interest = 0;
+        empty.closing = false;
+        _slots.resize(fd + 1, empty);
+    }
+    Slot &s = _slots[fd];
+    s.client = c;
+    s.dense = (int)_fds.size();
+    s.interest = interest;
+    s.closing = false;
+    _fds.push_back(fd);
+}
+
+bool ClientTable::setInterest(int fd, short interest) {
+    if (!get(fd)) return false;
+    Slot &s = _slots[fd];
+    if (s.interest == interest) return false;
+    s.interest = interest;
+    return true;
+}
+
+void ClientTable::markClosing(int fd) {
+    if (get(fd)) _slots[fd].closing = true;
+}
+
+Client *ClientTable::take(int fd) {
+    if (fd < 0 || (size_t)fd >= _slots.size() || !_slots[fd].client) return 0;
+    Slot &s = _slots[fd];
+    Client *c = s.client;
+    // Move the last live fd into the hole.
+    int last = _fds.back();
+    _fds[s.dense] = last;
+    _slots[last].dense = s.dense;
+    _fds.pop_back();
+    s.client = 0;
+    s.dense = -1;
+    s.interest = 0;
+    s.closing = false;
+    return c;
+}
@@ -6,51 +6,34 @@
 #include "Parser.hpp"
 #include "Utils.hpp"
 #include "Replies.hpp"
+#include "SharedBuf.hpp"
 #include <sstream>
 #include <cstdlib>
 
-static std::string prefixFor(Server &srv, Client *c) {
-    // :nick!user@server
-    std::string nick = c->nick().empty()? "*": c->nick();
-    std::string user = c->user().empty()? "user": c->user();
-    return ":" + nick + "!" + user + "@" + srv.serverName() + " ";
-}
-
 static bool ensureRegistered(Server &srv, Client *c) {
     // Registration finalization: PASS ok + NICK + USER set
     if (!c->registered() && c->passOk() && !c->nick().empty() && !c->user().empty()) {
         c->setRegistered(true);
         srv.sendToClient(c->fd(), RPL::welcome(srv.serverName(), c->nick()));
+        srv.sendToClient(c->fd(), RPL::isupport(srv.serverName(), c->nick(), srv.isupport()));
         return true;
     }
     return c->registered();
 }
 
 // PASS <password>
-void CMD::PASS(Server &srv, int fd, const std::vector<std::string> &p) {
+void CMD::PASS(Server &srv, int fd, const IrcParams &p) {
     Client *c = srv.getClient(fd);
     if (!c) return;
-    if (c->registered()) {
-        srv.sendToClient(fd, ERR::alreadyreg(srv.serverName(), c->nick()));
-        return;
-    }
-    if (p.size() < 1) {
-        srv.sendToClient(fd, ERR::needmoreparams(srv.serverName(), c->nick(), "PASS"));
-        return;
-    }
     if (p[0] == srv.password()) c->setPassOk(true);
     else srv.sendToClient(fd, ERR::passmismatch(srv.serverName(), c->nick()));
     ensureRegistered(srv, c);
 }
 
 // NICK <nick>
-void CMD::NICK(Server &srv, int fd, const std::vector<std::string> &p) {
+void CMD::NICK(Server &srv, int fd, const IrcParams &p) {
     Client *c = srv.getClient(fd);
     if (!c) return;
-    if (p.size() < 1) {
-        srv.sendToClient(fd, ERR::needmoreparams(srv.serverName(), c->nick(), "NICK"));
-        return;
-    }
     std::string newNick = p[0];
     if (!isValidNick(newNick)) {
         // Very basic: treat invalid as in use.
@@ -58,47 +41,40 @@ void CMD::NICK(Server &srv, int fd, const std::vector<std::string> &p) {
         return;
     }
     // Uniqueness check (case-insensitive).
-    if (srv.nickToFd().count(toLower(newNick))) {
+    if (srv.nickInUse(newNick)) {
         srv.sendToClient(fd, ERR::nicknameinuse(srv.serverName(), newNick));
         return;
     }
-    // Remove old mapping if existed.
-    if (!c->nick().empty()) srv.nickToFd().erase(toLower(c->nick()));
-    c->setNick(newNick);
-    srv.nickToFd()[toLower(newNick)] = fd;
+    // Tell everyone sharing a channel (once each) and the user, with the old prefix.
+    if (c->registered())
+        srv.sendToPeers(c, c->prefix() + "NICK :" + newNick + "\r\n", true);
+    // Keep the channels' names lists in step.
+    for (size_t i = 0; i < c->channels().size(); ++i)
+        c->channels()[i]->renameMember(fd, c->nick(), newNick);
+    srv.setNick(c, newNick);
     ensureRegistered(srv, c);
 }
 
 // USER <user> 0 * :realname
-void CMD::USER(Server &srv, int fd, const std::vector<std::string> &p) {
+void CMD::USER(Server &srv, int fd, const IrcParams &p) {
     Client *c = srv.getClient(fd);
     if (!c) return;
-    if (c->registered()) {
-        srv.sendToClient(fd, ERR::alreadyreg(srv.serverName(), c->nick()));
-        return;
-    }
-    if (p.size() < 4) {
-        srv.sendToClient(fd, ERR::needmoreparams(srv.serverName(), c->nick(), "USER"));
-        return;
-    }
     c->setUser(p[0]);
     c->setReal(p[3]);
     ensureRegistered(srv, c);
 }
 
 // JOIN <#chan>[ key]
-void CMD::JOIN(Server &srv, int fd, const std::vector<std::string> &p) {
+void CMD::JOIN(Server &srv, int fd, const IrcParams &p) {
     Client *c = srv.getClient(fd);
-    if (!c || !c->registered()) return;
-    if (p.size() < 1) {
-        srv.sendToClient(fd, ERR::needmoreparams(srv.serverName(), c->nick(), "JOIN"));
-        return;
-    }
+    if (!c) return;
     std::string chan = p[0];
     if (chan.empty() || chan[0] != '#') chan = "#" + chan;
     std::string key = p.size() >= 2 ? p[1] : "";
 
-    Channel *ch = srv.getOrCreateChannel(toLower(chan));
+    Channel *ch = srv.getOrCreateChannel(chan);
+    // Already there: nothing to do.
+    if (ch->isMember(fd)) return;
     // Enforce +i, +k, +l
     if (ch->inviteOnly() && !ch->isInvited(fd)) {
         srv.sendToClient(fd, ERR::inviteonlychan(srv.serverName(), c->nick(), chan));
@@ -114,13 +90,12 @@ void CMD::JOIN(Server &srv, int fd, const std::vector<std::string> &p) {
     }
     // First user becomes operator.
     bool wasEmpty = ch->memberCount() == 0;
-    ch->addMember(fd);
-    if (wasEmpty) ch->addOperator(fd);
+    srv.joinChannel(ch, c);
+    if (wasEmpty) ch->addOperator(fd, c->nick());
     ch->clearInvite(fd);
 
     // Broadcast JOIN
-    std::string pre = prefixFor(srv, c);
-    std::string joinLine = pre + "JOIN :" + chan + "\r\n";
+    std::string joinLine = c->prefix() + "JOIN :" + chan + "\r\n";
     srv.sendToChannel(chan, fd, joinLine);
     srv.sendToClient(fd, joinLine);
 
@@ -130,29 +105,19 @@ void CMD::JOIN(Server &srv, int fd, const std::vector<std::string> &p) {
     else
         srv.sendToClient(fd, RPL::notopic(srv.serverName(), c->nick(), chan));
 
-    // Build names list with '@' for ops.
-    std::string names;
-    const std::set<int> &m = ch->members();
-    for (std::set<int>::const_iterator it = m.begin(); it != m.end(); ++it) {
-        Client *mc = srv.getClient(*it);
-        if (!mc) continue;
-        if (names.size()) names += " ";
-        bool isOp = ch->isOperator(*it);
-        names += (isOp? "@":"") + mc->nick();
-    }
-    srv.sendToClient(fd, RPL::namreply(srv.serverName(), c->nick(), chan, names));
+    // Names list ('@' for ops) is kept by the channel, already cut into lines.
+    const std::vector<std::string> &names = ch->names();
+    for (size_t i = 0; i < names.size(); ++i)
+        if (!names[i].empty())
+            srv.sendToClient(fd, RPL::namreply(srv.serverName(), c->nick(), chan, names[i]));
     srv.sendToClient(fd, RPL::endofnames(srv.serverName(), c->nick(), chan));
 }
 
 
 // PART <#chan>[,#chan2...] [:reason]
-void CMD::PART(Server &srv, int fd, const std::vector<std::string> &p) {
+void CMD::PART(Server &srv, int fd, const IrcParams &p) {
     Client *c = srv.getClient(fd);
-    if (!c || !c->registered()) return;
-    if (p.size() < 1) {
-        srv.sendToClient(fd, ERR::needmoreparams(srv.serverName(), c->nick(), "PART"));
-        return;
-    }
+    if (!c) return;
     std::string chanlist = p[0];
     std::string reason = (p.size() >= 2) ? p[1] : "Leaving";
     std::vector<std::string> chans = split(chanlist, ',');
@@ -160,7 +125,7 @@ void CMD::PART(Server &srv, int fd, const std::vector<std::string> &p) {
         std::string chan = chans[i];
         if (chan.empty()) continue;
         if (chan[0] != '#') chan = "#" + chan;
-        Channel *ch = srv.findChannel(toLower(chan));
+        Channel *ch = srv.findChannel(chan);
         if (!ch) {
             srv.sendToClient(fd, ERR::nosuchchannel(srv.serverName(), c->nick(), chan));
             continue;
@@ -169,59 +134,81 @@ void CMD::PART(Server &srv, int fd, const std::vector<std::string> &p) {
             srv.sendToClient(fd, ERR::notonchannel(srv.serverName(), c->nick(), chan));
             continue;
         }
-        std::string pre = prefixFor(srv, c);
-        std::string line = pre + "PART " + chan + " :" + reason + "\r\n";
+        std::string line = c->prefix() + "PART " + chan + " :" + reason + "\r\n";
         // Notify others and self
         srv.sendToChannel(chan, fd, line);
         srv.sendToClient(fd, line);
         // Remove membership and maybe destroy empty channel
-        ch->removeMember(fd);
+        srv.partChannel(ch, c);
         if (ch->members().empty()) srv.removeChannelIfEmpty(ch->name());
     }
 }
-// PRIVMSG <target> :text
-void CMD::PRIVMSG(Server &srv, int fd, const std::vector<std::string> &p) {
+// PRIVMSG/NOTICE <target>{,<target>} :text
+// Each recipient gets the text once, addressed to the first target that
+// reaches them: someone in three of the listed channels sees one line, not
+// three. Channel lines are not echoed to the sender; naming oneself as a
+// target still delivers. NOTICE never triggers error replies.
+static void relay(Server &srv, int fd, const IrcParams &p, const char *verb, bool replies) {
     Client *c = srv.getClient(fd);
-    if (!c || !c->registered()) return;
-    if (p.size() < 2) {
-        srv.sendToClient(fd, ERR::needmoreparams(srv.serverName(), c->nick(), "PRIVMSG"));
+    if (!c) return;
+    const StrRef list = p[0];
+    size_t count = 1;
+    for (size_t i = 0; i < list.len; ++i) count += list[i] == ',';
+    if (count > MAXTARGETS) {
+        if (replies) srv.sendToClient(fd, ERR::toomanytargets(srv.serverName(), c->nick(), list));
         return;
     }
-    std::string target = p[0];
-    std::string text = p[1];
-    std::string line = prefixFor(srv, c) + "PRIVMSG " + target + " :" + text + "\r\n";
-    if (!target.empty() && target[0] == '#') {
-        Channel *ch = srv.findChannel(toLower(target));
-        if (!ch) {
-            srv.sendToClient(fd, ERR::nosuchchannel(srv.serverName(), c->nick(), target));
-            return;
+    // Only the target differs between the lines.
+    const std::string head = c->prefix() + verb + " ";
+    const std::string tail = " :" + p[1].str() + "\r\n";
+    srv.beginFanout();
+    for (size_t start = 0; start <= list.len; ) {
+        size_t end = start;
+        while (end < list.len && list[end] != ',') ++end;
+        StrRef target(list.data + start, end - start);
+        start = end + 1;
+        if (target.empty()) continue;
+        if (target[0] == '#') {
+            Channel *ch = srv.findChannel(target);
+            if (!ch) {
+                if (replies) srv.sendToClient(fd, ERR::nosuchchannel(srv.serverName(), c->nick(), target));
+                continue;
+            }
+            if (!ch->isMember(fd)) {
+                if (replies) srv.sendToClient(fd, ERR::notonchannel(srv.serverName(), c->nick(), target));
+                continue;
+            }
+            // Serialized once per target; members share the bytes.
+            std::string line = head + ch->name() + tail;
+            SharedBuf *buf = SharedBuf::create(line.data(), line.size());
+            srv.sendToMembers(ch, buf, fd); // not echoed to the sender
+            buf->release();
+        } else {
+            Client *dst = srv.getClientByNick(target);
+            if (!dst) {
+                if (replies) srv.sendToClient(fd, ERR::nosuchnick(srv.serverName(), c->nick(), target));
+                continue;
+            }
+            if (srv.markSeen(dst->fd())) srv.sendToClient(dst->fd(), head + dst->nick() + tail);
         }
-        if (!ch->isMember(fd)) {
-            srv.sendToClient(fd, ERR::notonchannel(srv.serverName(), c->nick(), target));
-            return;
-        }
-        srv.sendToChannel(target, fd, line);
-    } else {
-        Client *dst = srv.getClientByNick(target);
-        if (!dst) {
-            srv.sendToClient(fd, ERR::nosuchnick(srv.serverName(), c->nick(), target));
-            return;
-        }
-        srv.sendToClient(dst->fd(), line);
     }
 }
 
+void CMD::PRIVMSG(Server &srv, int fd, const IrcParams &p) {
+    relay(srv, fd, p, "PRIVMSG", true);
+}
+
+void CMD::NOTICE(Server &srv, int fd, const IrcParams &p) {
+    relay(srv, fd, p, "NOTICE", false);
+}
+
 // MODE <#chan> +/-[itkol] [args...]
-void CMD::MODE(Server &srv, int fd, const std::vector<std::string> &p) {
+void CMD::MODE(Server &srv, int fd, const IrcParams &p) {
     Client *c = srv.getClient(fd);
-    if (!c || !c->registered()) return;
-    if (p.size() < 1) {
-        srv.sendToClient(fd, ERR::needmoreparams(srv.serverName(), c->nick(), "MODE"));
-        return;
-    }
+    if (!c) return;
     std::string chan = p[0];
     if (chan.empty() || chan[0] != '#') chan = "#" + chan;
-    Channel *ch = srv.findChannel(toLower(chan));
+    Channel *ch = srv.findChannel(chan);
     if (!ch) {
         srv.sendToClient(fd, ERR::nosuchchannel(srv.serverName(), c->nick(), chan));
         return;
@@ -260,15 +247,15 @@ void CMD::MODE(Server &srv, int fd, const std::vector<std::string> &p) {
                 if (argi < p.size()) {
                     Client *who = srv.getClientByNick(p[argi++]);
                     if (who) {
-                        if (add) ch->addOperator(who->fd());
-                        else ch->removeOperator(who->fd());
+                        if (add) ch->addOperator(who->fd(), who->nick());
+                        else ch->removeOperator(who->fd(), who->nick());
                     }
                 }
                 break;
             case 'l':
                 if (add) {
                     if (argi < p.size()) {
-                        int lim = std::atoi(p[argi++].c_str());
+                        int lim = std::atoi(p[argi++].str().c_str());
                         if (lim > 0) ch->setLimit((size_t)lim);
                     }
                 } else ch->clearLimit();
@@ -280,16 +267,12 @@ void CMD::MODE(Server &srv, int fd, const std::vector<std::string> &p) {
 }
 
 // TOPIC <#chan> [:text]
-void CMD::TOPIC(Server &srv, int fd, const std::vector<std::string> &p) {
+void CMD::TOPIC(Server &srv, int fd, const IrcParams &p) {
     Client *c = srv.getClient(fd);
-    if (!c || !c->registered()) return;
-    if (p.size() < 1) {
-        srv.sendToClient(fd, ERR::needmoreparams(srv.serverName(), c->nick(), "TOPIC"));
-        return;
-    }
+    if (!c) return;
     std::string chan = p[0];
     if (chan.empty() || chan[0] != '#') chan = "#" + chan;
-    Channel *ch = srv.findChannel(toLower(chan));
+    Channel *ch = srv.findChannel(chan);
     if (!ch) {
         srv.sendToClient(fd, ERR::nosuchchannel(srv.serverName(), c->nick(), chan));
         return;
@@ -306,23 +289,19 @@ void CMD::TOPIC(Server &srv, int fd, const std::vector<std::string> &p) {
         return;
     }
     ch->setTopic(p[1]);
-    std::string line = prefixFor(srv, c) + "TOPIC " + chan + " :" + p[1] + "\r\n";
+    std::string line = c->prefix() + "TOPIC " + chan + " :" + p[1].str() + "\r\n";
     srv.sendToChannel(chan, fd, line);
     srv.sendToClient(fd, line);
 }
 
 // INVITE <nick> <#chan>
-void CMD::INVITE(Server &srv, int fd, const std::vector<std::string> &p) {
+void CMD::INVITE(Server &srv, int fd, const IrcParams &p) {
     Client *c = srv.getClient(fd);
-    if (!c || !c->registered()) return;
-    if (p.size() < 2) {
-        srv.sendToClient(fd, ERR::needmoreparams(srv.serverName(), c->nick(), "INVITE"));
-        return;
-    }
+    if (!c) return;
     std::string nick = p[0];
     std::string chan = p[1];
     if (chan.empty() || chan[0] != '#') chan = "#" + chan;
-    Channel *ch = srv.findChannel(toLower(chan));
+    Channel *ch = srv.findChannel(chan);
     if (!ch) {
         srv.sendToClient(fd, ERR::nosuchchannel(srv.serverName(), c->nick(), chan));
         return;
@@ -343,21 +322,17 @@ void CMD::INVITE(Server &srv, int fd, const std::vector<std::string> &p) {
     ch->addInvite(target->fd());
     // Notify inviter and invited.
     srv.sendToClient(fd, RPL::inviting(srv.serverName(), c->nick(), target->nick(), chan));
-    std::string line = prefixFor(srv, c) + "INVITE " + target->nick() + " :" + chan + "\r\n";
+    std::string line = c->prefix() + "INVITE " + target->nick() + " :" + chan + "\r\n";
     srv.sendToClient(target->fd(), line);
 }
 
 // KICK <#chan> <nick> [:reason]
-void CMD::KICK(Server &srv, int fd, const std::vector<std::string> &p) {
+void CMD::KICK(Server &srv, int fd, const IrcParams &p) {
     Client *c = srv.getClient(fd);
-    if (!c || !c->registered()) return;
-    if (p.size() < 2) {
-        srv.sendToClient(fd, ERR::needmoreparams(srv.serverName(), c->nick(), "KICK"));
-        return;
-    }
+    if (!c) return;
     std::string chan = p[0];
     if (chan.empty() || chan[0] != '#') chan = "#" + chan;
-    Channel *ch = srv.findChannel(toLower(chan));
+    Channel *ch = srv.findChannel(chan);
     if (!ch) {
         srv.sendToClient(fd, ERR::nosuchchannel(srv.serverName(), c->nick(), chan));
         return;
@@ -372,16 +347,92 @@ void CMD::KICK(Server &srv, int fd, const std::vector<std::string> &p) {
         return;
     }
     std::string reason = (p.size() >= 3) ? p[2] : "Kicked";
-    std::string line = prefixFor(srv, c) + "KICK " + chan + " " + target->nick() + " :" + reason + "\r\n";
+    std::string line = c->prefix() + "KICK " + chan + " " + target->nick() + " :" + reason + "\r\n";
     srv.sendToChannel(chan, fd, line);
     srv.sendToClient(fd, line);
     // Remove and notify target
-    ch->removeMember(target->fd());
+    srv.partChannel(ch, target);
     srv.removeChannelIfEmpty(chan);
 }
 
+// WHOIS <nick>
+void CMD::WHOIS(Server &srv, int fd, const IrcParams &p) {
+    Client *c = srv.getClient(fd);
+    if (!c) return;
+    Client *who = srv.getClientByNick(p[0]);
+    if (!who) {
+        srv.sendToClient(fd, ERR::nosuchnick(srv.serverName(), c->nick(), p[0]));
+        srv.sendToClient(fd, RPL::endofwhois(srv.serverName(), c->nick(), p[0]));
+        return;
+    }
+    srv.sendToClient(fd, RPL::whoisuser(srv.serverName(), c->nick(), who->nick(),
+                                        who->user(), who->host(), who->realname()));
+    // Only the user's own channels are visited.
+    std::string chans;
+    const std::vector<Channel*> &in = who->channels();
+    for (size_t i = 0; i < in.size(); ++i) {
+        if (chans.size()) chans += " ";
+        if (in[i]->isOperator(who->fd())) chans += "@";
+        chans += in[i]->name();
+    }
+    if (!chans.empty())
+        srv.sendToClient(fd, RPL::whoischannels(srv.serverName(), c->nick(), who->nick(), chans));
+    srv.sendToClient(fd, RPL::endofwhois(srv.serverName(), c->nick(), who->nick()));
+}
+
+// STATS <m|u|p>: command counts, uptime, or counters and handler latency (ns).
+void CMD::STATS(Server &srv, int fd, const IrcParams &p) {
+    Client *c = srv.getClient(fd);
+    if (!c) return;
+    const std::string &sn = srv.serverName();
+    char q = p[0].empty() ? '*' : p[0][0];
+    std::vector<ShardMetrics> shards;
+    srv.collectMetrics(shards);
+    ShardMetrics sum;
+    for (size_t i = 0; i < shards.size(); ++i) shards[i].addTo(sum);
+    if (q == 'm') {
+        for (size_t i = 0; i < Server::commandCount(); ++i)
+            if (sum.commands[i].count)
+                srv.sendToClient(fd, RPL::statscommands(sn, c->nick(), Server::commandName(i), sum.commands[i].count));
+    } else if (q == 'u') {
+        srv.sendToClient(fd, RPL::statsuptime(sn, c->nick(), srv.uptimeSec()));
+    } else if (q == 'p') {
+        std::ostringstream o;
+        o << "clients " << sum.clients << " users " << srv.userCount()
+          << " channels " << srv.channelCount() << " shards " << shards.size();
+        srv.sendToClient(fd, RPL::statsdebug(sn, c->nick(), o.str()));
+        o.str("");
+        o << "accepted " << sum.accepted << " rejected " << sum.rejected << " closed " << sum.closed
+          << " lines " << sum.linesIn << " unknown " << sum.unknown << " malformed " << sum.malformed
+          << " throttled " << sum.throttled << " deferred " << sum.deferred;
+        srv.sendToClient(fd, RPL::statsdebug(sn, c->nick(), o.str()));
+        o.str("");
+        o << "bytes in " << sum.bytesIn << " out " << sum.bytesOut << " writes " << sum.writes
+          << " sendq " << sum.sendq << " peak " << sum.sendqPeak << " dropped " << sum.sendqDropped
+          << " recvq " << sum.recvq << " peak " << sum.recvqPeak;
+        srv.sendToClient(fd, RPL::statsdebug(sn, c->nick(), o.str()));
+        o.str("");
+        PoolStats chp = srv.channelPoolStats();
+        o << "memory clients " << sum.clients << "/" << sum.poolCapacity << " " << sum.poolBytes << "B"
+          << " channels " << chp.inUse << "/" << chp.capacity << " " << chp.bytes << "B";
+        srv.sendToClient(fd, RPL::statsdebug(sn, c->nick(), o.str()));
+        o.str("");
+        o << "loops " << sum.loops << " wait_ms " << sum.waitNs / 1000000;
+        srv.sendToClient(fd, RPL::statsdebug(sn, c->nick(), o.str()));
+        for (size_t i = 0; i < Server::commandCount(); ++i) {
+            const Histogram &h = sum.commands[i];
+            if (!h.count) continue;
+            o.str("");
+            o << Server::commandName(i) << " calls " << h.count << " avg " << h.sum / h.count
+              << " p50 " << h.quantile(0.5) << " p99 " << h.quantile(0.99);
+            srv.sendToClient(fd, RPL::statsdebug(sn, c->nick(), o.str()));
+        }
+    }
+    srv.sendToClient(fd, RPL::endofstats(sn, c->nick(), q));
+}
+
 // PING :token
-void CMD::PING(Server &srv, int fd, const std::vector<std::string> &p) {
+void CMD::PING(Server &srv, int fd, const IrcParams &p) {
     Client *c = srv.getClient(fd);
     if (!c) return;
     std::string token = p.size()? p[0] : "token";
@@ -389,16 +440,20 @@ void CMD::PING(Server &srv, int fd, const std::vector<std::string> &p) {
     srv.sendToClient(fd, pong);
 }
 
+// PONG :token — the answer to our keepalive PING. Receiving it is all that
+// matters (any input does), so there is nothing left to do here.
+void CMD::PONG(Server &, int, const IrcParams &) {}
+
 
 // QUIT [#chan[,#chan2...]] | [:reason]
 // Note: Non-standard convenience: if the first param looks like a channel name ('#...'),
 // treat this as PART from the given channel(s) while keeping the connection open.
-void CMD::QUIT(Server &srv, int fd, const std::vector<std::string> &p) {
+void CMD::QUIT(Server &srv, int fd, const IrcParams &p) {
     Client *c = srv.getClient(fd);
     if (!c) return;
     if (!p.empty() && !p[0].empty() && p[0][0] == '#') {
-        // Behave like PART
-        PART(srv, fd, p);
+        // Behave like PART (which, unlike QUIT, needs a registered client).
+        if (c->registered()) PART(srv, fd, p);
         return;
     }
     std::string reason = p.size()? p[0] : "Quit";
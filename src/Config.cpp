@@ -0,0 +1,145 @@
+#include "Config.hpp"
+
+ServerConfig::ServerConfig()
+: backend("auto"), shards(1), casemapping("rfc1459"), metricsInterval(10),
+  pingInterval(120), pingTimeout(60), registrationTimeout(60), idleTimeout(0),
+  maxClients(0), maxPerIp(0), ipPrefix(32), acceptBudget(64), backlog(128),
+  sendq(1048576), sendqPolicy("disconnect"), recvq(8192), recvqPolicy("pause"),
+  floodRate(25), floodBurst(50), lineBudget(16),
+  utf8("any") {}
+
+// Parse a decimal in [lo, hi].
+static bool parseSize(const std::string &s, size_t lo, size_t hi, size_t &out) {
+    if (s.empty() || s.size() > 9) return false;
+    size_t v = 0;
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] < '0' || s[i] > '9') return false;
+        v = v * 10 + (s[i] - '0');
+    }
+    if (v < lo || v > hi) return false;
+    out = v;
+    return true;
+}
+
+bool applyConfigArg(ServerConfig &cfg, const std::string &arg, std::string &err) {
+    // Split "--name=value".
+    if (arg.compare(0, 2, "--") != 0) { err = "expected --name=value: " + arg; return false; }
+    size_t eq = arg.find('=');
+    std::string name = arg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2);
+    std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+
+    if (name == "backend") {
+        if (value != "auto" && value != "poll" && value != "epoll" && value != "epoll-et") {
+            err = "unknown backend: " + value;
+            return false;
+        }
+        cfg.backend = value;
+        return true;
+    }
+    if (name == "shards") {
+        if (!parseSize(value, 1, 256, cfg.shards)) { err = "--shards expects 1..256"; return false; }
+        return true;
+    }
+    if (name == "casemapping") {
+        if (value != "rfc1459" && value != "ascii") {
+            err = "unknown casemapping: " + value;
+            return false;
+        }
+        cfg.casemapping = value;
+        return true;
+    }
+    if (name == "metrics-file") {
+        if (value.empty()) { err = "--metrics-file expects a path"; return false; }
+        cfg.metricsFile = value;
+        return true;
+    }
+    if (name == "metrics-interval") {
+        if (!parseSize(value, 1, 3600, cfg.metricsInterval)) { err = "--metrics-interval expects 1..3600"; return false; }
+        return true;
+    }
+    if (name == "capture") {
+        if (value.empty()) { err = "--capture expects a path"; return false; }
+        cfg.capture = value;
+        return true;
+    }
+    if (name == "ping-interval") {
+        if (!parseSize(value, 0, 86400, cfg.pingInterval)) { err = "--ping-interval expects 0..86400"; return false; }
+        return true;
+    }
+    if (name == "ping-timeout") {
+        if (!parseSize(value, 1, 3600, cfg.pingTimeout)) { err = "--ping-timeout expects 1..3600"; return false; }
+        return true;
+    }
+    if (name == "registration-timeout") {
+        if (!parseSize(value, 0, 3600, cfg.registrationTimeout)) {
+            err = "--registration-timeout expects 0..3600";
+            return false;
+        }
+        return true;
+    }
+    if (name == "idle-timeout") {
+        if (!parseSize(value, 0, 604800, cfg.idleTimeout)) { err = "--idle-timeout expects 0..604800"; return false; }
+        return true;
+    }
+    if (name == "max-clients") {
+        if (!parseSize(value, 0, 10000000, cfg.maxClients)) { err = "--max-clients expects 0..10000000"; return false; }
+        return true;
+    }
+    if (name == "max-per-ip") {
+        if (!parseSize(value, 0, 10000000, cfg.maxPerIp)) { err = "--max-per-ip expects 0..10000000"; return false; }
+        return true;
+    }
+    if (name == "ip-prefix") {
+        if (!parseSize(value, 1, 32, cfg.ipPrefix)) { err = "--ip-prefix expects 1..32"; return false; }
+        return true;
+    }
+    if (name == "accept-budget") {
+        if (!parseSize(value, 1, 65536, cfg.acceptBudget)) { err = "--accept-budget expects 1..65536"; return false; }
+        return true;
+    }
+    if (name == "backlog") {
+        if (!parseSize(value, 1, 65535, cfg.backlog)) { err = "--backlog expects 1..65535"; return false; }
+        return true;
+    }
+    if (name == "sendq") {
+        if (!parseSize(value, 0, 999999999, cfg.sendq)) { err = "--sendq expects a byte count"; return false; }
+        return true;
+    }
+    if (name == "sendq-policy") {
+        if (value != "disconnect" && value != "drop") { err = "unknown sendq policy: " + value; return false; }
+        cfg.sendqPolicy = value;
+        return true;
+    }
+    if (name == "recvq") {
+        // A full line (512 bytes) must always fit.
+        if (!parseSize(value, 0, 999999999, cfg.recvq) || (cfg.recvq && cfg.recvq < 512)) {
+            err = "--recvq expects 0 or at least 512 bytes";
+            return false;
+        }
+        return true;
+    }
+    if (name == "recvq-policy") {
+        if (value != "pause" && value != "disconnect") { err = "unknown recvq policy: " + value; return false; }
+        cfg.recvqPolicy = value;
+        return true;
+    }
+    if (name == "flood-rate") {
+        if (!parseSize(value, 0, 1000, cfg.floodRate)) { err = "--flood-rate expects 0..1000"; return false; }
+        return true;
+    }
+    if (name == "flood-burst") {
+        if (!parseSize(value, 1, 100000, cfg.floodBurst)) { err = "--flood-burst expects 1..100000"; return false; }
+        return true;
+    }
+    if (name == "line-budget") {
+        if (!parseSize(value, 1, 100000, cfg.lineBudget)) { err = "--line-budget expects 1..100000"; return false; }
+        return true;
+    }
+    if (name == "utf8") {
+        if (value != "any" && value != "strict") { err = "--utf8 expects any or strict"; return false; }
+        cfg.utf8 = value;
+        return true;
+    }
+    err = "unknown option: " + arg;
+    return false;
+}
@@ -0,0 +1,53 @@
+#include "InBuf.hpp"
+#include "LineScan.hpp"
+#include <cstring>
+#include <new>
+
+InBuf::InBuf() : _data(0), _cap(0), _head(0), _tail(0), _scan(0), _flags(0) {}
+
+InBuf::~InBuf() {
+    ::operator delete(_data);
+}
+
+char *InBuf::space(size_t want) {
+    if (_cap - _tail >= want) return _data + _tail;
+    size_t used = _tail - _head;
+    if (_head && _cap - used >= want) {
+        // Compact: only the unread tail moves, and only when room runs out.
+        std::memmove(_data, _data + _head, used);
+    } else {
+        size_t cap = _cap ? _cap : 512;
+        while (cap - used < want) cap *= 2;
+        char *grown = static_cast<char *>(::operator new(cap));
+        if (used) std::memcpy(grown, _data + _head, used);
+        ::operator delete(_data);
+        _data = grown;
+        _cap = cap;
+    }
+    _scan = _scan > _head ? _scan - _head : 0;
+    _tail = used;
+    _head = 0;
+    return _data + _tail;
+}
+
+size_t InBuf::findLine() {
+    if (_scan < _head) _scan = _head;
+    size_t n = _tail - _scan;
+    size_t off = scanLine(_data + _scan, n, _flags);
+    if (off == n) {
+        // No line end yet. A CR at the very end is scanned again with the byte
+        // that follows it, which tells a line end from a bare CR.
+        _scan = _tail;
+        if (n && _data[_tail - 1] == '\r') --_scan;
+        return NPOS;
+    }
+    _scan += off;
+    return _scan - _head;
+}
+
+void InBuf::consume(size_t n) {
+    _head += n;
+    _flags = 0;
+    // Drained: start over at the front, so the common case never compacts.
+    if (_head == _tail) _head = _tail = _scan = 0;
+}
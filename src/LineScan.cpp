@@ -0,0 +1,164 @@
+#include "LineScan.hpp"
+#include <cstring>
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+#if defined(__x86_64__) && defined(__GNUC__)
+# include <immintrin.h>
+# define LINESCAN_AVX2 1 // compiled for the avx2 target, used only if the CPU has it
+#endif
+
+namespace {
+
+size_t scanScalar(const char *p, size_t n, unsigned &flags) {
+    unsigned f = 0;
+    size_t i = 0;
+    for (; i < n; ++i) {
+        unsigned char c = p[i];
+        if (c == '\n') break;
+        if (c == 0) f |= LINE_NUL;
+        else if (c == '\r') {
+            if (i + 1 < n && p[i + 1] != '\n') f |= LINE_CR;
+        } else if (c >= 0x80) f |= LINE_HIGH;
+    }
+    flags |= f;
+    return i;
+}
+
+#if defined(__SSE2__)
+// Flags for one block of width bytes at p[at], given its byte masks (bit i =
+// lane i). Only lanes before the first LF count. A CR in the last lane is
+// judged by the byte after the block, if the range has one.
+inline unsigned classify(unsigned long lf, unsigned long cr, unsigned long nul, unsigned long high,
+                         unsigned width, const char *p, size_t at, size_t n) {
+    unsigned long all = (1UL << width) - 1;
+    unsigned long before = lf ? (lf & -lf) - 1 : all;
+    unsigned f = 0;
+    if (nul & before) f |= LINE_NUL;
+    if (high & before) f |= LINE_HIGH;
+    unsigned long bare = cr & before & ~(lf >> 1);
+    unsigned long last = 1UL << (width - 1);
+    if ((bare & last) && (at + width >= n || p[at + width] == '\n')) bare &= ~last;
+    if (bare) f |= LINE_CR;
+    return f;
+}
+
+size_t scanSse2(const char *p, size_t n, unsigned &flags) {
+    const __m128i lfv = _mm_set1_epi8('\n'), crv = _mm_set1_epi8('\r'), zero = _mm_setzero_si128();
+    size_t at = 0;
+    for (; at + 16 <= n; at += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + at));
+        unsigned long lf = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, lfv));
+        unsigned long cr = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, crv));
+        unsigned long nul = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+        unsigned long high = (unsigned)_mm_movemask_epi8(v);
+        if (cr | nul | high) flags |= classify(lf, cr, nul, high, 16, p, at, n);
+        if (lf) return at + __builtin_ctzl(lf);
+    }
+    return at + scanScalar(p + at, n - at, flags);
+}
+#endif
+
+#if defined(LINESCAN_AVX2)
+__attribute__((target("avx2")))
+size_t scanAvx2(const char *p, size_t n, unsigned &flags) {
+    const __m256i lfv = _mm256_set1_epi8('\n'), crv = _mm256_set1_epi8('\r');
+    const __m256i zero = _mm256_setzero_si256();
+    size_t at = 0;
+    for (; at + 32 <= n; at += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + at));
+        unsigned long lf = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, lfv));
+        unsigned long cr = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, crv));
+        unsigned long nul = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero));
+        unsigned long high = (unsigned)_mm256_movemask_epi8(v);
+        if (cr | nul | high) flags |= classify(lf, cr, nul, high, 32, p, at, n);
+        if (lf) return at + __builtin_ctzl(lf);
+    }
+    return at + scanSse2(p + at, n - at, flags);
+}
+
+bool hasAvx2() {
+    __builtin_cpu_init(); // may run before main(), from g_scan's initializer
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+bool always() { return true; }
+
+typedef size_t (*ScanFn)(const char *, size_t, unsigned &);
+struct Impl {
+    const char *name;
+    ScanFn      fn;
+    bool      (*supported)();
+};
+// Best first.
+const Impl kImpls[] = {
+#if defined(LINESCAN_AVX2)
+    { "avx2", scanAvx2, hasAvx2 },
+#endif
+#if defined(__SSE2__)
+    { "sse2", scanSse2, always },
+#endif
+    { "scalar", scanScalar, always }
+};
+
+const Impl *pickBest() {
+    for (size_t i = 0; ; ++i)
+        if (kImpls[i].supported()) return &kImpls[i];
+}
+
+// Chosen during static initialization, before any shard thread exists.
+const Impl *g_impl = pickBest();
+
+} // namespace
+
+size_t scanLine(const char *p, size_t n, unsigned &flags) {
+    return g_impl->fn(p, n, flags);
+}
+
+bool validUtf8(const char *s, size_t n) {
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(s);
+    size_t i = 0;
+    while (i < n) {
+#if defined(__SSE2__)
+        // Skip ASCII 16 bytes at a time; sequences are checked one by one.
+        while (i + 16 <= n && !_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i))))
+            i += 16;
+        if (i == n) break;
+#endif
+        unsigned c = p[i];
+        if (c < 0x80) {
+            ++i;
+            continue;
+        }
+        size_t len;
+        unsigned cp, min;
+        if (c >= 0xC2 && c <= 0xDF) { len = 2; cp = c & 0x1F; min = 0x80; }
+        else if (c >= 0xE0 && c <= 0xEF) { len = 3; cp = c & 0x0F; min = 0x800; }
+        else if (c >= 0xF0 && c <= 0xF4) { len = 4; cp = c & 0x07; min = 0x10000; }
+        else return false;
+        if (n - i < len) return false;
+        for (size_t k = 1; k < len; ++k) {
+            if ((p[i + k] & 0xC0) != 0x80) return false;
+            cp = (cp << 6) | (p[i + k] & 0x3F);
+        }
+        if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return false;
+        i += len;
+    }
+    return true;
+}
+
+const char *lineScanImpl() {
+    return g_impl->name;
+}
+
+bool useLineScanImpl(const char *name) {
+    for (size_t i = 0; i < sizeof(kImpls) / sizeof(kImpls[0]); ++i) {
+        if (std::strcmp(kImpls[i].name, name) != 0) continue;
+        if (!kImpls[i].supported()) return false;
+        g_impl = &kImpls[i];
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,161 @@
+
+#include "Metrics.hpp"
+#include <ctime>
+#include <cstdio>
+#include <sstream>
+
+unsigned long monoNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000000000UL + (unsigned long)ts.tv_nsec;
+}
+
+Histogram::Histogram() : count(0), sum(0) {
+    for (size_t i = 0; i < BUCKETS; ++i) buckets[i] = 0;
+}
+
+void Histogram::add(unsigned long v) {
+    size_t i = v ? sizeof(unsigned long) * 8 - __builtin_clzl(v) : 0;
+    if (i >= BUCKETS) i = BUCKETS - 1;
+    metricAdd(buckets[i], 1);
+    metricAdd(count, 1);
+    metricAdd(sum, v);
+}
+
+void Histogram::addTo(Histogram &out) const {
+    out.count += metricGet(count);
+    out.sum += metricGet(sum);
+    for (size_t i = 0; i < BUCKETS; ++i) out.buckets[i] += metricGet(buckets[i]);
+}
+
+unsigned long Histogram::quantile(double q) const {
+    if (!count) return 0;
+    unsigned long rank = (unsigned long)(q * count), seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += buckets[i];
+        if (seen > rank) return 1UL << i;
+    }
+    return 1UL << (BUCKETS - 1);
+}
+
+ShardMetrics::ShardMetrics()
+: accepted(0), closed(0), rejected(0), bytesIn(0), bytesOut(0), writes(0), linesIn(0), unknown(0), malformed(0), throttled(0), deferred(0),
+  loops(0), waitNs(0), sendqDropped(0), clients(0), sendq(0), sendqPeak(0), recvq(0), recvqPeak(0),
+  poolCapacity(0), poolBytes(0) {}
+
+void ShardMetrics::addTo(ShardMetrics &out) const {
+    out.accepted += metricGet(accepted);
+    out.closed += metricGet(closed);
+    out.rejected += metricGet(rejected);
+    out.bytesIn += metricGet(bytesIn);
+    out.bytesOut += metricGet(bytesOut);
+    out.writes += metricGet(writes);
+    out.linesIn += metricGet(linesIn);
+    out.unknown += metricGet(unknown);
+    out.malformed += metricGet(malformed);
+    out.throttled += metricGet(throttled);
+    out.deferred += metricGet(deferred);
+    out.loops += metricGet(loops);
+    out.waitNs += metricGet(waitNs);
+    out.sendqDropped += metricGet(sendqDropped);
+    out.clients += metricGet(clients);
+    out.sendq += metricGet(sendq);
+    if (metricGet(sendqPeak) > out.sendqPeak) out.sendqPeak = metricGet(sendqPeak);
+    out.recvq += metricGet(recvq);
+    if (metricGet(recvqPeak) > out.recvqPeak) out.recvqPeak = metricGet(recvqPeak);
+    out.poolCapacity += metricGet(poolCapacity);
+    out.poolBytes += metricGet(poolBytes);
+    for (size_t i = 0; i < MAX_COMMANDS; ++i) commands[i].addTo(out.commands[i]);
+}
+
+namespace {
+
+void header(std::ostringstream &o, const char *name, const char *type, const char *help) {
+    o << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+}
+
+void perShard(std::ostringstream &o, const std::vector<ShardMetrics> &shards, const char *name,
+              const char *type, const char *help, unsigned long ShardMetrics::*field) {
+    header(o, name, type, help);
+    for (size_t i = 0; i < shards.size(); ++i)
+        o << name << "{shard=\"" << i << "\"} " << metricGet(shards[i].*field) << "\n";
+}
+
+// Nanoseconds as exact decimal seconds: a double through operator<< keeps six
+// significant digits, and a counter that stops moving breaks rate().
+void seconds(std::ostringstream &o, unsigned long ns) {
+    char buf[32];
+    std::snprintf(buf, sizeof buf, "%lu.%09lu", ns / 1000000000UL, ns % 1000000000UL);
+    o << buf;
+}
+
+} // namespace
+
+std::string formatPrometheus(const std::vector<ShardMetrics> &shards,
+                             const std::vector<const char *> &commands,
+                             size_t users, const PoolStats &channels, unsigned long uptimeSec) {
+    std::ostringstream o;
+    header(o, "ircd_uptime_seconds", "gauge", "Seconds since the server started.");
+    o << "ircd_uptime_seconds " << uptimeSec << "\n";
+    header(o, "ircd_users", "gauge", "Registered nicks.");
+    o << "ircd_users " << users << "\n";
+    header(o, "ircd_channels", "gauge", "Channels.");
+    o << "ircd_channels " << channels.inUse << "\n";
+    perShard(o, shards, "ircd_clients", "gauge", "Connected clients.", &ShardMetrics::clients);
+    perShard(o, shards, "ircd_connections_accepted_total", "counter", "Connections accepted.", &ShardMetrics::accepted);
+    perShard(o, shards, "ircd_connections_closed_total", "counter", "Connections closed.", &ShardMetrics::closed);
+    perShard(o, shards, "ircd_connections_rejected_total", "counter", "Connections refused by admission limits.", &ShardMetrics::rejected);
+    perShard(o, shards, "ircd_received_bytes_total", "counter", "Bytes received from clients.", &ShardMetrics::bytesIn);
+    perShard(o, shards, "ircd_sent_bytes_total", "counter", "Bytes sent to clients.", &ShardMetrics::bytesOut);
+    perShard(o, shards, "ircd_send_calls_total", "counter", "sendmsg() calls writing client output.", &ShardMetrics::writes);
+    perShard(o, shards, "ircd_lines_total", "counter", "Lines received.", &ShardMetrics::linesIn);
+    perShard(o, shards, "ircd_unknown_commands_total", "counter", "Lines with an unknown command.", &ShardMetrics::unknown);
+    perShard(o, shards, "ircd_malformed_lines_total", "counter", "Lines dropped for bytes the protocol forbids.", &ShardMetrics::malformed);
+    perShard(o, shards, "ircd_throttled_total", "counter", "Times a client's lines were held back by flood control.", &ShardMetrics::throttled);
+    perShard(o, shards, "ircd_deferred_total", "counter", "Times a client's lines were left for the next loop iteration.", &ShardMetrics::deferred);
+    perShard(o, shards, "ircd_loop_iterations_total", "counter", "Event loop iterations.", &ShardMetrics::loops);
+    perShard(o, shards, "ircd_sendq_bytes", "gauge", "Bytes queued for clients.", &ShardMetrics::sendq);
+    perShard(o, shards, "ircd_sendq_peak_bytes", "gauge", "Largest client send queue seen.", &ShardMetrics::sendqPeak);
+    perShard(o, shards, "ircd_sendq_dropped_bytes_total", "counter", "Broadcast bytes dropped from full send queues.", &ShardMetrics::sendqDropped);
+    perShard(o, shards, "ircd_recvq_bytes", "gauge", "Bytes received, not yet processed.", &ShardMetrics::recvq);
+    perShard(o, shards, "ircd_recvq_peak_bytes", "gauge", "Largest client receive queue seen.", &ShardMetrics::recvqPeak);
+    header(o, "ircd_pool_objects", "gauge", "Objects in use in the Client (per shard) and Channel pools.");
+    for (size_t i = 0; i < shards.size(); ++i)
+        o << "ircd_pool_objects{pool=\"client\",shard=\"" << i << "\"} " << metricGet(shards[i].clients) << "\n";
+    o << "ircd_pool_objects{pool=\"channel\"} " << channels.inUse << "\n";
+    header(o, "ircd_pool_capacity", "gauge", "Slots allocated by each pool.");
+    for (size_t i = 0; i < shards.size(); ++i)
+        o << "ircd_pool_capacity{pool=\"client\",shard=\"" << i << "\"} " << metricGet(shards[i].poolCapacity) << "\n";
+    o << "ircd_pool_capacity{pool=\"channel\"} " << channels.capacity << "\n";
+    header(o, "ircd_pool_bytes", "gauge", "Memory held by each pool's slabs.");
+    for (size_t i = 0; i < shards.size(); ++i)
+        o << "ircd_pool_bytes{pool=\"client\",shard=\"" << i << "\"} " << metricGet(shards[i].poolBytes) << "\n";
+    o << "ircd_pool_bytes{pool=\"channel\"} " << channels.bytes << "\n";
+    header(o, "ircd_wait_seconds_total", "counter", "Time spent waiting on the event backend.");
+    for (size_t i = 0; i < shards.size(); ++i) {
+        o << "ircd_wait_seconds_total{shard=\"" << i << "\"} ";
+        seconds(o, metricGet(shards[i].waitNs));
+        o << "\n";
+    }
+
+    // Handler latency, summed over shards.
+    header(o, "ircd_command_duration_seconds", "histogram", "Time spent in each command handler.");
+    for (size_t c = 0; c < commands.size() && c < ShardMetrics::MAX_COMMANDS; ++c) {
+        Histogram h;
+        for (size_t i = 0; i < shards.size(); ++i) shards[i].commands[c].addTo(h);
+        unsigned long cumulative = 0;
+        for (size_t b = 0; b < Histogram::BUCKETS; ++b) {
+            cumulative += h.buckets[b];
+            o << "ircd_command_duration_seconds_bucket{command=\"" << commands[c]
+              << "\",le=\"";
+            seconds(o, 1UL << b);
+            o << "\"} " << cumulative << "\n";
+        }
+        o << "ircd_command_duration_seconds_bucket{command=\"" << commands[c] << "\",le=\"+Inf\"} " << h.count << "\n"
+          << "ircd_command_duration_seconds_sum{command=\"" << commands[c] << "\"} ";
+        seconds(o, h.sum);
+        o << "\n"
+          << "ircd_command_duration_seconds_count{command=\"" << commands[c] << "\"} " << h.count << "\n";
+    }
+    return o.str();
+}
@@ -0,0 +1,107 @@
+#include "OutQueue.hpp"
+
+OutQueue::OutQueue()
+: _ring(8), _head(0), _count(0), _off(0), _bytes(0), _spare(0) {}
+
+OutQueue::~OutQueue() {
+    while (_count) popFront();
+    if (_spare) _spare->release();
+}
+
+void OutQueue::push(SharedBuf *b, bool own) {
+    if (_count == _ring.size()) {
+        // Full: unroll into a ring twice the size.
+        std::vector<Entry> bigger(_ring.size() * 2);
+        for (size_t i = 0; i < _count; ++i) bigger[i] = at(i);
+        _ring.swap(bigger);
+        _head = 0;
+    }
+    Entry &e = at(_count++);
+    e.buf = b;
+    e.own = own;
+}
+
+void OutQueue::popFront() {
+    Entry &e = at(0);
+    if (e.own && !_spare && e.buf->unique()) {
+        e.buf->reset();
+        _spare = e.buf;
+    } else {
+        e.buf->release();
+    }
+    _head = (_head + 1) & (_ring.size() - 1);
+    --_count;
+}
+
+void OutQueue::append(const char *data, size_t len) {
+    if (!len) return;
+    _bytes += len;
+    // Fill the private tail chunk first, then open new ones.
+    if (_count && at(_count - 1).own) {
+        SharedBuf *tail = at(_count - 1).buf;
+        size_t n = len < tail->spare() ? len : tail->spare();
+        tail->append(data, n);
+        data += n;
+        len -= n;
+    }
+    while (len) {
+        SharedBuf *b;
+        if (_spare && len <= CHUNK) {
+            b = _spare;
+            _spare = 0;
+        } else {
+            b = SharedBuf::chunk(len > CHUNK ? len : (size_t)CHUNK);
+        }
+        size_t n = len < b->spare() ? len : b->spare();
+        b->append(data, n);
+        push(b, true);
+        data += n;
+        len -= n;
+    }
+}
+
+void OutQueue::appendShared(SharedBuf *b) {
+    if (!b->size()) return;
+    b->retain();
+    push(b, false);
+    _bytes += b->size();
+}
+
+int OutQueue::iov(struct iovec *iov, int max) const {
+    int n = 0;
+    for (size_t i = 0; i < _count && n < max; ++i, ++n) {
+        size_t off = i ? 0 : _off;
+        iov[n].iov_base = const_cast<char *>(at(i).buf->data() + off);
+        iov[n].iov_len = at(i).buf->size() - off;
+    }
+    return n;
+}
+
+size_t OutQueue::dropShared(size_t need) {
+    // Survivors slide down in place and keep their order.
+    size_t freed = 0, kept = 0;
+    for (size_t i = 0; i < _count; ++i) {
+        Entry e = at(i);
+        if (freed < need && !e.own && !(i == 0 && _off)) {
+            freed += e.buf->size();
+            e.buf->release();
+            continue;
+        }
+        at(kept++) = e;
+    }
+    _count = kept;
+    _bytes -= freed;
+    return freed;
+}
+
+void OutQueue::consume(size_t n) {
+    _bytes -= n;
+    // Drop fully sent buffers; the rest of a partial one stays at the front.
+    while (n && _count) {
+        size_t left = at(0).buf->size() - _off;
+        if (n < left) { _off += n; return; }
+        n -= left;
+        popFront();
+        _off = 0;
+    }
+}
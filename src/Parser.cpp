@@ -1,28 +1,53 @@
 
 #include "Parser.hpp"
-#include "Utils.hpp"
 
-ParsedLine parseIrcLine(const std::string &line) {
-    ParsedLine out;
-    // Basic split by spaces except when a param starts with ':' -> trailing
-    std::vector<std::string> toks = split(line, ' ');
-    if (toks.empty()) return out;
-    out.command = toks[0];
-    // Gather params; if we encounter a token starting with ':', rest of line is one param
-    bool trailing = false;
-    std::string trail;
-    for (size_t i = 1; i < toks.size(); ++i) {
-        if (!trailing && !toks[i].empty() && toks[i][0] == ':') {
-            trailing = true;
-            // strip leading ':'
-            trail = toks[i].substr(1);
-        } else if (trailing) {
-            if (!trail.empty()) trail += " ";
-            trail += toks[i];
-        } else {
-            out.params.push_back(toks[i]);
+// Index of the first ' ' at or after i (or end).
+static size_t wordEnd(const char *s, size_t i, size_t end) {
+    while (i < end && s[i] != ' ') ++i;
+    return i;
+}
+
+static size_t skipSpaces(const char *s, size_t i, size_t end) {
+    while (i < end && s[i] == ' ') ++i;
+    return i;
+}
+
+bool parseIrcLine(const char *line, size_t len, IrcMessage &out) {
+    out = IrcMessage();
+    // Ignore the line terminator if the caller left it in.
+    while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) --len;
+    size_t i = skipSpaces(line, 0, len);
+
+    // Optional @tags and :prefix, each a single word.
+    if (i < len && line[i] == '@') {
+        size_t e = wordEnd(line, i, len);
+        out.tags = StrRef(line + i + 1, e - i - 1);
+        i = skipSpaces(line, e, len);
+    }
+    if (i < len && line[i] == ':') {
+        size_t e = wordEnd(line, i, len);
+        out.prefix = StrRef(line + i + 1, e - i - 1);
+        i = skipSpaces(line, e, len);
+    }
+    if (i >= len) return false;
+    size_t e = wordEnd(line, i, len);
+    out.command = StrRef(line + i, e - i);
+    i = e;
+
+    // Middle params are separated by one or more spaces; ':' starts the trailing
+    // one, which runs to the end of the line. The 15th param is always trailing.
+    IrcParams &p = out.params;
+    for (;;) {
+        i = skipSpaces(line, i, len);
+        if (i >= len) break;
+        if (line[i] == ':' || p.n == IrcParams::MAX - 1) {
+            if (line[i] == ':') ++i;
+            p.v[p.n++] = StrRef(line + i, len - i);
+            break;
         }
+        e = wordEnd(line, i, len);
+        p.v[p.n++] = StrRef(line + i, e - i);
+        i = e;
     }
-    if (trailing) out.params.push_back(trail);
-    return out;
+    return true;
 }
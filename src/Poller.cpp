@@ -0,0 +1,141 @@
+// Poller.cpp — poll() fallback and epoll (level/edge-triggered) backends.
+
+#include "Poller.hpp"
+#include <cerrno>
+#include <unistd.h>
+#ifdef __linux__
+# include <sys/epoll.h>
+#endif
+
+namespace {
+
+// Portable fallback: one pollfd vector, kept dense. _index maps fd -> slot so
+// modify() is O(1) and remove() swaps the last entry into the hole.
+class PollPoller : public Poller {
+    std::vector<struct pollfd> _pfds;
+    std::vector<int>           _index; // fd -> position in _pfds, -1 if absent
+public:
+    const char *name() const { return "poll"; }
+
+    bool add(int fd, short events) {
+        if (fd < 0) return false;
+        if ((size_t)fd >= _index.size()) _index.resize(fd + 1, -1);
+        if (_index[fd] >= 0) return modify(fd, events);
+        struct pollfd p;
+        p.fd = fd;
+        p.events = events;
+        p.revents = 0;
+        _index[fd] = (int)_pfds.size();
+        _pfds.push_back(p);
+        return true;
+    }
+
+    bool modify(int fd, short events) {
+        if (fd < 0 || (size_t)fd >= _index.size() || _index[fd] < 0) return false;
+        _pfds[_index[fd]].events = events;
+        return true;
+    }
+
+    void remove(int fd) {
+        if (fd < 0 || (size_t)fd >= _index.size() || _index[fd] < 0) return;
+        size_t i = (size_t)_index[fd];
+        size_t last = _pfds.size() - 1;
+        if (i != last) {
+            _pfds[i] = _pfds[last];
+            _index[_pfds[i].fd] = (int)i;
+        }
+        _pfds.pop_back();
+        _index[fd] = -1;
+    }
+
+    int wait(int timeoutMs, std::vector<PollEvent> &out) {
+        out.clear();
+        int ret = ::poll(_pfds.empty() ? 0 : &_pfds[0], _pfds.size(), timeoutMs);
+        if (ret <= 0) return ret;
+        // poll() itself is O(n); at least hand back only the ready entries.
+        for (size_t i = 0; i < _pfds.size() && (int)out.size() < ret; ++i) {
+            if (!_pfds[i].revents) continue;
+            PollEvent e;
+            e.fd = _pfds[i].fd;
+            e.revents = _pfds[i].revents;
+            out.push_back(e);
+        }
+        return (int)out.size();
+    }
+};
+
+#ifdef __linux__
+class EpollPoller : public Poller {
+    int  _epfd;
+    bool _edge;
+    std::vector<struct epoll_event> _evbuf;
+
+    unsigned int toEpoll(short events) const {
+        unsigned int e = 0;
+        if (events & POLLIN) e |= EPOLLIN;
+        if (events & POLLOUT) e |= EPOLLOUT;
+        if (_edge) e |= EPOLLET;
+        return e;
+    }
+    bool ctl(int op, int fd, short events) {
+        struct epoll_event ev;
+        ev.events = toEpoll(events);
+        ev.data.u64 = 0;
+        ev.data.fd = fd;
+        return ::epoll_ctl(_epfd, op, fd, &ev) == 0;
+    }
+public:
+    EpollPoller(bool edge) : _epfd(::epoll_create1(EPOLL_CLOEXEC)), _edge(edge), _evbuf(256) {}
+    ~EpollPoller() { if (_epfd >= 0) ::close(_epfd); }
+    bool ok() const { return _epfd >= 0; }
+
+    const char *name() const { return _edge ? "epoll-et" : "epoll"; }
+    bool edgeTriggered() const { return _edge; }
+
+    bool add(int fd, short events) { return ctl(EPOLL_CTL_ADD, fd, events); }
+    bool modify(int fd, short events) { return ctl(EPOLL_CTL_MOD, fd, events); }
+    void remove(int fd) {
+        struct epoll_event ev; // non-null for pre-2.6.9 kernels
+        ::epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, &ev);
+    }
+
+    int wait(int timeoutMs, std::vector<PollEvent> &out) {
+        out.clear();
+        int n = ::epoll_wait(_epfd, &_evbuf[0], (int)_evbuf.size(), timeoutMs);
+        if (n <= 0) return n;
+        for (int i = 0; i < n; ++i) {
+            unsigned int ev = _evbuf[i].events;
+            PollEvent e;
+            e.fd = _evbuf[i].data.fd;
+            e.revents = 0;
+            if (ev & EPOLLIN) e.revents |= POLLIN;
+            if (ev & EPOLLOUT) e.revents |= POLLOUT;
+            if (ev & EPOLLERR) e.revents |= POLLERR;
+            if (ev & EPOLLHUP) e.revents |= POLLHUP;
+            out.push_back(e);
+        }
+        // A full buffer means more may be pending; grow for the next round.
+        if ((size_t)n == _evbuf.size()) _evbuf.resize(_evbuf.size() * 2);
+        return n;
+    }
+};
+#endif
+
+} // namespace
+
+Poller *Poller::create(const std::string &kind) {
+    if (kind == "poll") return new PollPoller();
+#ifdef __linux__
+    if (kind == "auto" || kind == "epoll" || kind == "epoll-et") {
+        EpollPoller *p = new EpollPoller(kind == "epoll-et");
+        if (p->ok()) return p;
+        delete p;
+        // epoll unavailable (e.g. sandboxed): "auto" still gets a working backend.
+        if (kind == "auto") return new PollPoller();
+        return 0;
+    }
+#else
+    if (kind == "auto") return new PollPoller();
+#endif
+    return 0;
+}
@@ -1,5 +1,7 @@
 
 #include "Replies.hpp"
+#include <sstream>
+#include <cstdio>
 
 static std::string pfx(const std::string &server) {
     return ":" + server + " ";
@@ -9,6 +11,9 @@ namespace RPL {
 std::string welcome(const std::string &server, const std::string &nick) {
     return pfx(server) + "001 " + nick + " :Welcome to ft_irc, " + nick + "\r\n";
 }
+std::string isupport(const std::string &server, const std::string &nick, const std::string &tokens) {
+    return pfx(server) + "005 " + nick + " " + tokens + " :are supported by this server\r\n";
+}
 std::string topic(const std::string &server, const std::string &nick, const std::string &chan, const std::string &topic) {
     return pfx(server) + "332 " + nick + " " + chan + " :" + topic + "\r\n";
 }
@@ -21,6 +26,32 @@ std::string namreply(const std::string &server, const std::string &nick, const s
 std::string endofnames(const std::string &server, const std::string &nick, const std::string &chan) {
     return pfx(server) + "366 " + nick + " " + chan + " :End of /NAMES list.\r\n";
 }
+std::string whoisuser(const std::string &server, const std::string &nick, const std::string &target, const std::string &user, const std::string &host, const std::string &real) {
+    return pfx(server) + "311 " + nick + " " + target + " " + user + " " + host + " * :" + real + "\r\n";
+}
+std::string whoischannels(const std::string &server, const std::string &nick, const std::string &target, const std::string &chans) {
+    return pfx(server) + "319 " + nick + " " + target + " :" + chans + "\r\n";
+}
+std::string endofwhois(const std::string &server, const std::string &nick, const std::string &target) {
+    return pfx(server) + "318 " + nick + " " + target + " :End of /WHOIS list.\r\n";
+}
+std::string statscommands(const std::string &server, const std::string &nick, const std::string &cmd, unsigned long count) {
+    std::ostringstream o;
+    o << count;
+    return pfx(server) + "212 " + nick + " " + cmd + " " + o.str() + " 0 0\r\n";
+}
+std::string statsuptime(const std::string &server, const std::string &nick, unsigned long seconds) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "Server Up %lu days %lu:%02lu:%02lu",
+                  seconds / 86400, seconds / 3600 % 24, seconds / 60 % 60, seconds % 60);
+    return pfx(server) + "242 " + nick + " :" + buf + "\r\n";
+}
+std::string statsdebug(const std::string &server, const std::string &nick, const std::string &text) {
+    return pfx(server) + "249 " + nick + " :" + text + "\r\n";
+}
+std::string endofstats(const std::string &server, const std::string &nick, char query) {
+    return pfx(server) + "219 " + nick + " " + std::string(1, query) + " :End of /STATS report\r\n";
+}
 std::string inviting(const std::string &server, const std::string &nick, const std::string &target, const std::string &chan) {
     return pfx(server) + "341 " + nick + " " + target + " " + chan + "\r\n";
 }
@@ -63,4 +94,7 @@ std::string inviteonlychan(const std::string &server, const std::string &nick, c
 std::string channelisfull(const std::string &server, const std::string &nick, const std::string &chan) {
     return pfx(server) + "471 " + nick + " " + chan + " :Cannot join channel (+l)\r\n";
 }
+std::string toomanytargets(const std::string &server, const std::string &nick, const std::string &target) {
+    return pfx(server) + "407 " + nick + " " + target + " :Too many targets, message not delivered\r\n";
+}
 }
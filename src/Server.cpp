@@ -1,11 +1,9 @@
-
-// Server.cpp — single-poll nonblocking IRC server core.
-// Key points to satisfy correction mandatory checks:
-// - Exactly one poll() loop handling listen/read/write (no other poll, no blocking I/O).
-// - fcntl(fd, F_SETFL, O_NONBLOCK); and no other fcntl flags (Mac-compatible).
-// - We never rely on errno==EAGAIN to reattempt reads/writes; we only act on POLLIN/POLLOUT.
+// Server.cpp — shared IRC state (nicks, channels) and the shards that serve it.
+// Socket handling lives in Shard.cpp; everything here runs with the state lock held,
+// except start/run/stop.
 
 #include "Server.hpp"
+#include "Shard.hpp"
 #include "Parser.hpp"
 #include "Commands.hpp"
 #include "Utils.hpp"
@@ -14,172 +12,234 @@
 #include <cstdio>
 #include <cerrno>
 
-Server::Server(const std::string &serverName, const std::string &password)
-: _serverName(serverName), _password(password), _listenFd(-1) {}
+Server::Server(const std::string &serverName, const std::string &password, const ServerConfig &cfg)
+: _serverName(serverName), _password(password), _cfg(cfg),
+  _casemap(cfg.casemapping == "ascii" ? CASEMAP_ASCII : CASEMAP_RFC1459),
+  _startNs(monoNs()), _capture(0),
+  _admission(cfg.maxClients, cfg.maxPerIp, cfg.ipPrefix),
+  _current(0), _nextId(0), _epoch(0), _nicks(_casemap), _channels(_casemap) {
+    pthread_mutex_init(&_lock, 0);
+    _isupport = std::string("CASEMAPPING=") + caseMappingName(_casemap)
+              + " CHANTYPES=# PREFIX=(o)@ CHANMODES=,k,l,it NICKLEN=" + itostr(NICKLEN)
+              + " TARGMAX=PRIVMSG:" + itostr(MAXTARGETS) + ",NOTICE:" + itostr(MAXTARGETS);
+    if (cfg.utf8 == "strict") _isupport += " UTF8ONLY";
+}
 
 Server::~Server() {
     stop();
+    for (size_t i = 0; i < _shards.size(); ++i) delete _shards[i];
+    delete _capture;
     // free channels
-    for (std::map<std::string, Channel*>::iterator it = _channels.begin(); it != _channels.end(); ++it)
-        delete it->second;
-    // free clients (should be none by here)
-    for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
-        delete it->second;
-    }
+    for (size_t i = 0; i < _channels.slots(); ++i)
+        if (_channels.usedAt(i)) _channelPool.destroy(_channels.valueAt(i));
+    pthread_mutex_destroy(&_lock);
 }
 
 bool Server::start(unsigned short port) {
-    // Create IPv4 TCP socket.
-    _listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
-    if (_listenFd < 0) { std::perror("socket"); return false; }
-
-    // SO_REUSEADDR for quick restarts.
-    int yes = 1;
-    if (setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) < 0) {
-        std::perror("setsockopt");
-        ::close(_listenFd);
-        _listenFd = -1;
-        return false;
+    if (!_cfg.capture.empty()) {
+        _capture = new Capture();
+        if (!_capture->open(_cfg.capture)) return false;
     }
-
-    // Set non-blocking exactly as allowed by subject (Mac note).
-    if (fcntl(_listenFd, F_SETFL, O_NONBLOCK) < 0) {
-        std::perror("fcntl");
-        ::close(_listenFd);
-        _listenFd = -1;
-        return false;
+    // One shard per thread; with more than one, each binds its own listener
+    // with SO_REUSEPORT and the kernel spreads incoming connections.
+    for (size_t i = 0; i < _cfg.shards; ++i) {
+        Shard *sh = new Shard(*this, i);
+        _shards.push_back(sh);
+        _outbox.push_back((Delivery *)0);
+        if (!sh->start(port, _cfg.shards > 1, _cfg.backend)) return false;
     }
+    return true;
+}
 
-    // Bind to all interfaces (INADDR_ANY) on the given port (correction requires this).
-    struct sockaddr_in addr;
-    std::memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port = htons(port);
-    if (bind(_listenFd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        std::perror("bind");
-        ::close(_listenFd);
-        _listenFd = -1;
-        return false;
-    }
+void Server::run() {
+    _startNs = monoNs();
+    // Shard 0 runs on the calling thread, the others on their own.
+    for (size_t i = 1; i < _shards.size(); ++i)
+        if (!_shards[i]->spawn()) return;
+    _shards[0]->loop();
+}
 
-    if (listen(_listenFd, 128) < 0) {
-        std::perror("listen");
-        ::close(_listenFd);
-        _listenFd = -1;
-        return false;
-    }
+void Server::stop() {
+    for (size_t i = 0; i < _shards.size(); ++i) _shards[i]->stop();
+    _owner.clear();
+    _nicks.clear();
+}
 
-    // Add listening socket to poll vector.
-    struct pollfd p;
-    p.fd = _listenFd;
-    p.events = POLLIN;   // we only accept() when poll says so
-    p.revents = 0;
-    _pfds.push_back(p);
-    return true;
+void Server::lock(Shard *sh) {
+    pthread_mutex_lock(&_lock);
+    _current = sh;
 }
 
-void Server::stop() {
-    // Close listen fd if open.
-    if (_listenFd >= 0) {
-        ::close(_listenFd);
-        _listenFd = -1;
-    }
-    // Close all client fds.
-    for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
-        ::close(it->first);
+void Server::unlock() {
+    // Hand each other shard everything this iteration produced for it: one push apiece.
+    for (size_t i = 0; i < _outbox.size(); ++i) {
+        if (!_outbox[i]) continue;
+        _shards[i]->post(_outbox[i]);
+        _outbox[i] = 0;
     }
-    _clients.clear();
-    _pfds.clear();
-    _nickToFd.clear();
+    _current = 0;
+    pthread_mutex_unlock(&_lock);
+}
+
+void Server::attachClient(Shard *sh, Client *c) {
+    int fd = c->fd();
+    if ((size_t)fd >= _owner.size()) _owner.resize(fd + 1, (Shard *)0);
+    _owner[fd] = sh;
+    c->setId(++_nextId);
+}
+
+void Server::collectMetrics(std::vector<ShardMetrics> &out) const {
+    out.assign(_shards.size(), ShardMetrics());
+    for (size_t i = 0; i < _shards.size(); ++i) _shards[i]->metrics().addTo(out[i]);
+}
+
+unsigned long Server::uptimeSec() const {
+    return (monoNs() - _startNs) / 1000000000UL;
+}
+
+void Server::dumpMetrics(Shard *sh) {
+    std::vector<ShardMetrics> shards;
+    std::vector<const char *> names;
+    for (size_t i = 0; i < commandCount(); ++i) names.push_back(commandName(i));
+    lock(sh);
+    collectMetrics(shards);
+    std::string text = formatPrometheus(shards, names, _nicks.size(), _channelPool.stats(), uptimeSec());
+    unlock();
+    // Write beside the target and rename, so a scraper never reads half a file.
+    std::string tmp = _cfg.metricsFile + ".tmp";
+    FILE *f = std::fopen(tmp.c_str(), "w");
+    if (!f) { std::perror(tmp.c_str()); return; }
+    bool ok = std::fwrite(text.data(), 1, text.size(), f) == text.size();
+    if (std::fclose(f) != 0 || !ok || std::rename(tmp.c_str(), _cfg.metricsFile.c_str()) != 0)
+        std::perror(_cfg.metricsFile.c_str());
 }
 
 Client *Server::getClient(int fd) {
-    std::map<int, Client*>::iterator it = _clients.find(fd);
-    if (it == _clients.end()) return 0;
-    return it->second;
+    // Disconnected clients are invisible even before reapClosed() frees them.
+    if (fd < 0 || (size_t)fd >= _owner.size() || !_owner[fd]) return 0;
+    return _owner[fd]->client(fd);
+}
+
+Client *Server::getClientByNick(const StrRef &nick) {
+    int *fd = _nicks.find(nick);
+    return fd ? getClient(*fd) : 0;
 }
 
-Client *Server::getClientByNick(const std::string &nick) {
-    std::map<std::string, int>::iterator it = _nickToFd.find(toLower(nick));
-    if (it == _nickToFd.end()) return 0;
-    return getClient(it->second);
+bool Server::nickInUse(const StrRef &nick) {
+    return _nicks.find(nick) != 0;
+}
+
+void Server::setNick(Client *c, const std::string &nick) {
+    if (!c->nick().empty()) _nicks.erase(c->nick());
+    c->setNick(nick);
+    _nicks.set(nick, c->fd());
 }
 
 Channel *Server::getOrCreateChannel(const std::string &name) {
-    std::map<std::string, Channel*>::iterator it = _channels.find(toLower(name));
-    if (it != _channels.end()) return it->second;
-    Channel *c = new Channel(name);
-    _channels[toLower(name)] = c;
+    if (Channel **found = _channels.find(name)) return *found;
+    // A 353 line is ":<server> 353 <nick> = <chan> :<names>\r\n", at most 512 bytes.
+    size_t fixed = 1 + _serverName.size() + 5 + NICKLEN + 3 + name.size() + 2 + 2;
+    size_t room = fixed < 512 - (NICKLEN + 1) ? 512 - fixed : NICKLEN + 1;
+    Channel *c = _channelPool.create(name, room);
+    _channels.set(name, c);
     return c;
 }
 
-Channel *Server::findChannel(const std::string &name) {
-    std::map<std::string, Channel*>::iterator it = _channels.find(toLower(name));
-    if (it == _channels.end()) return 0;
-    return it->second;
+Channel *Server::findChannel(const StrRef &name) {
+    Channel **found = _channels.find(name);
+    return found ? *found : 0;
 }
 
 void Server::removeChannelIfEmpty(const std::string &name) {
-    std::map<std::string, Channel*>::iterator it = _channels.find(toLower(name));
-    if (it == _channels.end()) return;
-    if (it->second->members().empty()) {
-        delete it->second;
-        _channels.erase(it);
-    }
+    Channel **found = _channels.find(name);
+    if (!found || !(*found)->members().empty()) return;
+    _channelPool.destroy(*found);
+    _channels.erase(name);
 }
 
-void Server::handleListenEvent(short revents) {
-    if (!(revents & POLLIN)) return;
-    // Accept as many connections as the kernel offers now.
-    for (;;) {
-        struct sockaddr_in cli;
-        socklen_t len = sizeof(cli);
-        int cfd = ::accept(_listenFd, (struct sockaddr*)&cli, &len);
-        if (cfd < 0) {
-            // Non-blocking accept: when no more, we get EAGAIN/EWOULDBLOCK. Just stop.
-            break;
-        }
-        // Non-blocking for the client exactly as allowed.
-        if (fcntl(cfd, F_SETFL, O_NONBLOCK) < 0) {
-            std::perror("fcntl(client)");
-            ::close(cfd);
-            continue;
-        }
-        // Track client.
-        Client *cl = new Client(cfd);
-        _clients[cfd] = cl;
-
-        // Add to poll list with POLLIN initially.
-        struct pollfd p;
-        p.fd = cfd;
-        p.events = POLLIN; // read only until we have something to write
-        p.revents = 0;
-        _pfds.push_back(p);
+void Server::sendToClient(int fd, const std::string &msg) {
+    Client *c = getClient(fd);
+    if (!c) return;
+    if (_owner[fd] == _current) {
+        // Written by the shard's flush at the end of this iteration.
+        _current->enqueue(c, msg);
+        return;
     }
+    SharedBuf *buf = SharedBuf::create(msg.data(), msg.size());
+    sendShared(fd, buf, false);
+    buf->release();
 }
 
-void Server::sendToClient(int fd, const std::string &msg) {
+void Server::sendShared(int fd, SharedBuf *buf, bool broadcast) {
     Client *c = getClient(fd);
     if (!c) return;
-    c->enqueueOut(msg);
-    // Ensure POLLOUT is set for this fd, so we only write after poll() signals it.
-    for (size_t i = 0; i < _pfds.size(); ++i) {
-        if (_pfds[i].fd == fd) {
-            _pfds[i].events = POLLIN | POLLOUT;
-            break;
-        }
+    Shard *sh = _owner[fd];
+    if (sh == _current) {
+        _current->enqueue(c, buf, broadcast);
+        return;
     }
+    // Another shard's client: batch it for that shard's inbox (posted in unlock()).
+    Delivery *&d = _outbox[sh->index()];
+    if (!d) d = new Delivery();
+    Delivery::Item it;
+    it.fd = fd;
+    it.id = c->id();
+    it.buf = buf;
+    it.broadcast = broadcast;
+    buf->retain();
+    d->items.push_back(it);
+}
+
+void Server::sendToPeers(Client *c, const std::string &line, bool toSelf) {
+    // Everyone sharing at least one channel with c gets the line once, however many
+    // channels they share: members are stamped with the current epoch as they are sent to.
+    beginFanout();
+    SharedBuf *buf = SharedBuf::create(line.data(), line.size());
+    if (toSelf) sendShared(c->fd(), buf, false);
+    markSeen(c->fd());
+    const std::vector<Channel*> &chans = c->channels();
+    for (size_t i = 0; i < chans.size(); ++i) sendToMembers(chans[i], buf);
+    buf->release();
+}
+
+void Server::beginFanout() {
+    if (++_epoch == 0) { _seen.assign(_seen.size(), 0); _epoch = 1; }
+}
+
+void Server::sendToMembers(Channel *ch, SharedBuf *buf, int except) {
+    const std::vector<Member> &m = ch->members();
+    for (size_t i = 0; i < m.size(); ++i)
+        if (m[i].fd != except && markSeen(m[i].fd)) sendShared(m[i].fd, buf);
+}
+
+bool Server::markSeen(int fd) {
+    if ((size_t)fd >= _seen.size()) _seen.resize(fd + 1, 0);
+    if (_seen[fd] == _epoch) return false;
+    _seen[fd] = _epoch;
+    return true;
+}
+
+void Server::joinChannel(Channel *ch, Client *c) {
+    ch->addMember(c->fd(), c->nick());
+    c->addChannel(ch);
+}
+
+void Server::partChannel(Channel *ch, Client *c) {
+    ch->removeMember(c->fd(), c->nick());
+    c->removeChannel(ch);
 }
 
 void Server::sendToChannel(const std::string &chan, int fromFd, const std::string &line) {
     Channel *c = findChannel(chan);
     if (!c) return;
-    for (std::set<int>::const_iterator it = c->members().begin(); it != c->members().end(); ++it) {
-        int tfd = *it;
-        if (tfd == fromFd) continue;
-        sendToClient(tfd, line);
+    // Serialize once; each member queues a reference to the same bytes.
+    SharedBuf *buf = SharedBuf::create(line.data(), line.size());
+    const std::vector<Member> &m = c->members();
+    for (size_t i = 0; i < m.size(); ++i) {
+        if (m[i].fd == fromFd) continue;
+        sendShared(m[i].fd, buf);
     }
+    buf->release();
 }
 
 // Server.cpp
@@ -189,123 +249,26 @@ void Server::disconnectClient(int fd, const std::string &reason) {
     Client *c = getClient(fd);                                  // (1) fd’den client nesnesini al
     if (!c) return;                                              // (2) Yoksa çık
 
-    // (3) _channels üzerinde dolaşırken erase etmeyeceğiz; boş kalanları sonra sileceğiz.
-    std::vector<std::string> toErase;                            // (4) Sonradan silinecek kanal adları
-
-    for (std::map<std::string, Channel*>::iterator it = _channels.begin();
-         it != _channels.end(); ++it) {                          // (5) Tüm kanallar üzerinde güvenli iterate
-        Channel *ch = it->second;                                // (6) Kanal ptr
-        if (!ch) continue;                                       // (7) Emniyet
-
-        if (ch->isMember(fd)) {                                  // (8) Bu client bu kanalda mı?
-            // (9) Kanal üyelerine QUIT yayını; ayrılan kişi kendisini görmez.
-            std::string prefix = ":" + (c->nick().empty()? "*":c->nick())
-                               + "!" + c->user() + "@localhost ";
-            std::string quitmsg = prefix + "QUIT :" + reason + "\r\n";
-            sendToChannel(ch->name(), fd, quitmsg);              // (10) Üyelere gönder
-
-            ch->removeMember(fd);                                // (11) Üyelikten çıkar (op/invite de temizleniyor)
-
-            if (ch->members().empty()) {                         // (12) Kanal boşaldıysa
-                toErase.push_back(ch->name());                   // (13) Adını listeye ekle (şimdi değil, sonra sil)
-            }
-        }
-    }
-
-    // (14) Artık iterator yok; güvenle sil
-    for (size_t i = 0; i < toErase.size(); ++i) {
-        removeChannelIfEmpty(toErase[i]);                        // (15) Kanalı map’ten kaldır (erase burada güvenli)
+    // (3) QUIT satırını bir kez kur; yalnızca kullanıcının kendi kanallarındaki kişilere,
+    //     her birine bir kez gönder (ayrılan kişi kendisini görmez). Tüm kanalları taramıyoruz.
+    sendToPeers(c, c->prefix() + "QUIT :" + reason + "\r\n", false);
+
+    // (4) Üyeliklerden çık (op/invite de temizleniyor); boşalan kanalı sil.
+    //     Kopya üzerinde dönüyoruz çünkü partChannel() c->channels()’ı değiştirir.
+    std::vector<Channel*> chans = c->channels();
+    for (size_t i = 0; i < chans.size(); ++i) {
+        std::string name = chans[i]->name();
+        partChannel(chans[i], c);
+        removeChannelIfEmpty(name);
     }
 
     // (16) Nick -> fd haritasını temizle
-    if (!c->nick().empty()) _nickToFd.erase(toLower(c->nick()));
-
-    // (17) pollfd vektöründen bu fd’yi çıkar
-    for (size_t i = 0; i < _pfds.size(); ++i) {
-        if (_pfds[i].fd == fd) { _pfds.erase(_pfds.begin()+i); break; }
-    }
-
-    // (18) Soketi kapat, client’ı map’ten çıkar ve bellekten sil
-    ::close(fd);
-    _clients.erase(fd);
-    delete c;
-}
-
-
-void Server::handleClientEvent(size_t i) {
-    struct pollfd &p = _pfds[i];
-    Client *c = getClient(p.fd);
-    if (!c) return;
-
-    // Read if POLLIN set (we only call recv after poll says ready).
-    if (p.revents & POLLIN) {
-        char buf[4096];
-        for (;;) {
-            ssize_t n = ::recv(p.fd, buf, sizeof(buf), 0);
-            if (n > 0) {
-                c->appendIn(std::string(buf, n));
-            } else if (n == 0) {
-                // Peer closed gracefully.
-                disconnectClient(p.fd, "Client quit");
-                return;
-            } else {
-                // n < 0: in non-blocking mode, no more data gives EAGAIN/EWOULDBLOCK.
-                // We never spin on errno, per correction — simply stop reading now.
-                break;
-            }
-        }
-        // Process complete lines.
-        for (;;) {
-            std::string &in = const_cast<std::string&>(c->inbuf());
-            size_t pos = in.find('\n');
-            if (pos == std::string::npos) break;
-            std::string raw = trimCRLF(in.substr(0, pos+1));
-            c->consumeIn(pos+1);
-            if (!raw.empty()) handleLine(p.fd, raw);
-        }
-    }
-
-    // Write if we have something and POLLOUT is set.
-    if ((p.revents & POLLOUT) && !c->outbuf().empty()) {
-        const std::string &out = c->outbuf();
-        ssize_t n = ::send(p.fd, out.data(), out.size(), 0);
-        if (n > 0) {
-            c->consumeOut((size_t)n);
-        } else if (n < 0) {
-            // On EAGAIN, just skip until poll says POLLOUT again.
-        }
-    }
-    // If output is empty, we can clear POLLOUT bit to save CPU.
-    if (c) { // c might be deleted by disconnect
-        if (c->outbuf().empty()) {
-            _pfds[i].events = POLLIN;
-        } else {
-            _pfds[i].events = POLLIN | POLLOUT;
-        }
-    }
-}
-
-void Server::run() {
-    // Single loop, single poll. All accepts/reads/writes are only performed after this poll returns.
-    while (true) {
-        int ret = ::poll(&_pfds[0], _pfds.size(), -1);
-        if (ret < 0) {
-            // If interrupted, continue; else exit.
-            if (errno == EINTR) continue;
-            std::perror("poll");
-            break;
-        }
-        // Iterate snapshot of size, as we might erase entries (disconnect).
-        size_t n = _pfds.size();
-        for (size_t i = 0; i < n; ++i) {
-            // Listening socket at index 0 originally; but we don't rely on that — we check by fd.
-            if (_pfds[i].fd == _listenFd) {
-                handleListenEvent(_pfds[i].revents);
-            } else {
-                // Safeguard if fd disappeared (disconnect may shrink vector); bounds check.
-                if (i < _pfds.size())
-                    handleClientEvent(i);
-            }
-        }
-    }
+    if (!c->nick().empty()) _nicks.erase(c->nick());
+
+    // (17) Sahibi olan shard fd’yi izlemeyi bıraksın. Soketi hemen kapatmıyoruz: bu turda
+    //      fd numarası yeniden kullanılmasın ve çağıran kod (ör. QUIT işleyen processInput)
+    //      c’yi kullanmaya devam edebilsin. getClient() artık 0 döner; kapatma/silme
+    //      shard’ın reapClosed()’unda, tur sonunda. Yalnızca sahip shard çağırır.
+    _owner[fd]->detach(fd);
+    _owner[fd] = 0;
 }
@@ -2,31 +2,118 @@
 #include "Server.hpp"
 #include "Parser.hpp"
 #include "Commands.hpp"
+#include "Replies.hpp"
 #include "Utils.hpp"
+#include "Shard.hpp"
 #include <iostream>
 
-void Server::handleLine(int fd, const std::string &line) {
-    // Parse and dispatch a single IRC command line.
+namespace {
+
+// Checks done once here instead of at the top of every CMD:: handler.
+enum {
+    NEEDS_REG  = 1, // silently ignored until the client is registered
+    BEFORE_REG = 2, // ERR_ALREADYREGISTRED once the client is registered
+    KEEPALIVE  = 4, // does not count as activity for --idle-timeout
+    NO_ERRORS  = 8  // too few parameters: ignored without ERR_NEEDMOREPARAMS
+};
+
+struct CommandSpec {
+    const char  *name;      // upper case, as echoed in ERR_NEEDMOREPARAMS
+    CMD::Handler handler;
+    unsigned     flags;
+    size_t       minParams;
+};
+
+// Grouped by (length, first letter) so lookup() can jump straight to a bucket;
+// the busiest command of a bucket goes first.
+const CommandSpec kCommands[] = {
+    { "PRIVMSG", CMD::PRIVMSG, NEEDS_REG,  2 }, // 0  (7, p)
+    { "PING",    CMD::PING,    KEEPALIVE,  0 }, // 1  (4, p)
+    { "PONG",    CMD::PONG,    KEEPALIVE,  0 }, // 2
+    { "PART",    CMD::PART,    NEEDS_REG,  1 }, // 3
+    { "PASS",    CMD::PASS,    BEFORE_REG, 1 }, // 4
+    { "JOIN",    CMD::JOIN,    NEEDS_REG,  1 }, // 5  (4, j)
+    { "NICK",    CMD::NICK,    0,          1 }, // 6  (4, n)
+    { "USER",    CMD::USER,    BEFORE_REG, 4 }, // 7  (4, u)
+    { "MODE",    CMD::MODE,    NEEDS_REG,  1 }, // 8  (4, m)
+    { "KICK",    CMD::KICK,    NEEDS_REG,  2 }, // 9  (4, k)
+    { "QUIT",    CMD::QUIT,    0,          0 }, // 10 (4, q)
+    { "TOPIC",   CMD::TOPIC,   NEEDS_REG,  1 }, // 11 (5, t)
+    { "INVITE",  CMD::INVITE,  NEEDS_REG,  2 }, // 12 (6, i)
+    { "WHOIS",   CMD::WHOIS,   NEEDS_REG,  1 }, // 13 (5, w)
+    { "STATS",   CMD::STATS,   NEEDS_REG,  1 }, // 14 (5, s)
+    { "NOTICE",  CMD::NOTICE,  NEEDS_REG | NO_ERRORS, 2 } // 15 (6, n)
+};
+
+inline char lower(char ch) { return (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch; }
+
+// name is upper case and has the same length as cmd.
+bool sameCommand(const StrRef &cmd, const char *name) {
+    for (size_t i = 0; i < cmd.len; ++i)
+        if (lower(cmd[i]) != lower(name[i])) return false;
+    return true;
+}
+
+#define BUCKET(len, ch) (((len) << 8) | (unsigned char)(ch))
+
+// Case-insensitive lookup without copying the command: the switch picks the
+// (length, first letter) bucket, then at most four names are compared.
+const CommandSpec *lookup(const StrRef &cmd) {
+    if (cmd.len < 4 || cmd.len > 7) return 0;
+    size_t first, count;
+    switch (BUCKET(cmd.len, lower(cmd[0]))) {
+        case BUCKET(7, 'p'): first = 0;  count = 1; break;
+        case BUCKET(4, 'p'): first = 1;  count = 4; break;
+        case BUCKET(4, 'j'): first = 5;  count = 1; break;
+        case BUCKET(4, 'n'): first = 6;  count = 1; break;
+        case BUCKET(4, 'u'): first = 7;  count = 1; break;
+        case BUCKET(4, 'm'): first = 8;  count = 1; break;
+        case BUCKET(4, 'k'): first = 9;  count = 1; break;
+        case BUCKET(4, 'q'): first = 10; count = 1; break;
+        case BUCKET(5, 't'): first = 11; count = 1; break;
+        case BUCKET(6, 'i'): first = 12; count = 1; break;
+        case BUCKET(5, 'w'): first = 13; count = 1; break;
+        case BUCKET(5, 's'): first = 14; count = 1; break;
+        case BUCKET(6, 'n'): first = 15; count = 1; break;
+        default: return 0;
+    }
+    for (size_t i = first; i < first + count; ++i)
+        if (sameCommand(cmd, kCommands[i].name)) return &kCommands[i];
+    return 0;
+}
+
+#undef BUCKET
+
+} // namespace
+
+size_t Server::commandCount() { return sizeof(kCommands) / sizeof(kCommands[0]); }
+const char *Server::commandName(size_t i) { return kCommands[i].name; }
+
+void Server::handleLine(int fd, const char *line, size_t len) {
+    // Parse and dispatch a single IRC command line (parsed in place, no copies).
     Client *c = getClient(fd);
-    if (!c) 
+    if (!c)
 		return;
-    ParsedLine pl = parseIrcLine(line);
-    std::string cmd = toLower(pl.command);
-
-    if (cmd == "pass") CMD::PASS(*this, fd, pl.params);
-    else if (cmd == "nick") CMD::NICK(*this, fd, pl.params);
-    else if (cmd == "user") CMD::USER(*this, fd, pl.params);
-    else if (cmd == "join") CMD::JOIN(*this, fd, pl.params);
-    else if (cmd == "part") CMD::PART(*this, fd, pl.params);
-    else if (cmd == "privmsg") CMD::PRIVMSG(*this, fd, pl.params);
-    else if (cmd == "mode") CMD::MODE(*this, fd, pl.params);
-    else if (cmd == "topic") CMD::TOPIC(*this, fd, pl.params);
-    else if (cmd == "invite") CMD::INVITE(*this, fd, pl.params);
-    else if (cmd == "kick") CMD::KICK(*this, fd, pl.params);
-    else if (cmd == "ping") CMD::PING(*this, fd, pl.params);
-    else if (cmd == "quit") CMD::QUIT(*this, fd, pl.params);
-    else {
+    IrcMessage msg;
+    if (!parseIrcLine(line, len, msg)) return;
+    const CommandSpec *cs = lookup(msg.command);
+    ShardMetrics &m = _current->metrics();
+    if (!cs) {
         // Silently ignore unknown commands to keep the server simple/human-like.
-        (void)0;
+        metricAdd(m.unknown, 1);
+        return;
+    }
+    if ((cs->flags & NEEDS_REG) && !c->registered()) return;
+    if ((cs->flags & BEFORE_REG) && c->registered()) {
+        sendToClient(fd, ERR::alreadyreg(_serverName, c->nick()));
+        return;
+    }
+    if (msg.params.size() < cs->minParams) {
+        if (!(cs->flags & NO_ERRORS)) sendToClient(fd, ERR::needmoreparams(_serverName, c->nick(), cs->name));
+        return;
     }
+    unsigned long t0 = monoNs();
+    if (!(cs->flags & KEEPALIVE)) c->touchActive(t0 / 1000000);
+    cs->handler(*this, fd, msg.params);
+    m.commands[cs - kCommands].add(monoNs() - t0);
 }
@@ -0,0 +1,30 @@
+#include "SharedBuf.hpp"
+#include <cstring>
+#include <new>
+
+SharedBuf *SharedBuf::alloc(size_t cap) {
+    // One allocation: header followed by the bytes.
+    void *mem = ::operator new(sizeof(SharedBuf) + cap);
+    return new (mem) SharedBuf(cap);
+}
+
+SharedBuf *SharedBuf::create(const char *data, size_t len) {
+    SharedBuf *b = alloc(len);
+    b->append(data, len);
+    return b;
+}
+
+SharedBuf *SharedBuf::chunk(size_t cap) {
+    return alloc(cap);
+}
+
+void SharedBuf::append(const char *data, size_t len) {
+    if (len) std::memcpy(bytes() + _size, data, len);
+    _size += len;
+}
+
+void SharedBuf::release() {
+    if (__sync_sub_and_fetch(&_refs, 1) > 0) return;
+    this->~SharedBuf();
+    ::operator delete(this);
+}
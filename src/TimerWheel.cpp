@@ -0,0 +1,105 @@
+#include "TimerWheel.hpp"
+
+TimerWheel::TimerWheel(unsigned long tickMs)
+: _tick(0), _tickMs(tickMs ? tickMs : 1), _count(0) {
+    for (size_t l = 0; l < LEVELS; ++l) {
+        _occupied[l] = 0;
+        for (size_t i = 0; i < SLOTS; ++i) {
+            _slots[l][i].next = &_slots[l][i];
+            _slots[l][i].prev = &_slots[l][i];
+        }
+    }
+}
+
+void TimerWheel::start(unsigned long nowMs) {
+    _tick = nowMs / _tickMs;
+}
+
+void TimerWheel::file(Timer *t) {
+    // Level l holds timers less than SLOTS^(l+1) ticks away, indexed by bits
+    // [BITS*l, BITS*(l+1)) of the due tick. Late timers go in the current slot;
+    // ones past the top level's horizon wait there and fire at the horizon.
+    unsigned long due = t->due > _tick ? t->due : _tick;
+    unsigned long delta = due - _tick;
+    size_t l = 0;
+    while (l < LEVELS - 1 && delta >= 1UL << (BITS * (l + 1))) ++l;
+    if (delta >= 1UL << (BITS * LEVELS)) due = _tick + (1UL << (BITS * LEVELS)) - 1;
+    size_t idx = (due >> (BITS * l)) & (SLOTS - 1);
+    Timer *head = &_slots[l][idx];
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+    t->slot = l * SLOTS + idx;
+    _occupied[l] |= 1UL << idx;
+}
+
+void TimerWheel::unlink(Timer *t) {
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    size_t l = t->slot / SLOTS, idx = t->slot % SLOTS;
+    if (_slots[l][idx].next == &_slots[l][idx]) _occupied[l] &= ~(1UL << idx);
+    t->next = 0;
+    t->prev = 0;
+}
+
+void TimerWheel::schedule(Timer *t, unsigned long atMs) {
+    if (t->pending()) unlink(t);
+    else ++_count;
+    t->due = (atMs + _tickMs - 1) / _tickMs;
+    file(t);
+}
+
+void TimerWheel::cancel(Timer *t) {
+    if (!t->pending()) return;
+    unlink(t);
+    --_count;
+}
+
+bool TimerWheel::cascade(size_t level) {
+    // Re-file the timers of the level's current slot: they are now less than
+    // SLOTS^level ticks away, so each lands one level down (or lower).
+    size_t idx = (_tick >> (BITS * level)) & (SLOTS - 1);
+    Timer *head = &_slots[level][idx];
+    Timer *t = head->next;
+    head->next = head;
+    head->prev = head;
+    _occupied[level] &= ~(1UL << idx);
+    while (t != head) {
+        Timer *next = t->next;
+        file(t);
+        t = next;
+    }
+    return idx == 0;
+}
+
+void TimerWheel::advance(unsigned long nowMs, std::vector<Timer *> &out) {
+    unsigned long target = nowMs / _tickMs;
+    while (_count && _tick <= target) {
+        size_t idx = _tick & (SLOTS - 1);
+        if (idx == 0)
+            for (size_t l = 1; l < LEVELS && cascade(l); ++l) {}
+        Timer *head = &_slots[0][idx];
+        while (head->next != head) {
+            Timer *t = head->next;
+            unlink(t);
+            --_count;
+            out.push_back(t);
+        }
+        ++_tick;
+    }
+    // Nothing pending: skip the idle ticks at once.
+    if (_tick <= target) _tick = target + 1;
+}
+
+int TimerWheel::timeoutMs(unsigned long nowMs) const {
+    if (!_count) return -1;
+    // Next occupied level-0 slot in this turn, else the end of the turn, where
+    // the next level-1 slot cascades down (at once if the turn starts now).
+    size_t idx = _tick & (SLOTS - 1);
+    unsigned long ahead = _occupied[0] >> idx;
+    unsigned long next = _tick;
+    if (idx) next += ahead ? (unsigned long)__builtin_ctzl(ahead) : SLOTS - idx;
+    unsigned long at = next * _tickMs;
+    return at <= nowMs ? 0 : (int)(at - nowMs);
+}
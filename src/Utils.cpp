@@ -3,12 +3,6 @@
 #include <cctype>
 #include <sstream>
 
-std::string toLower(const std::string &s) {
-    std::string r(s);
-    for (size_t i = 0; i < r.size(); ++i) r[i] = std::tolower(r[i]);
-    return r;
-}
-
 std::string trimCRLF(const std::string &s) {
     // Strip trailing CR and/or LF.
     size_t end = s.size();
@@ -18,7 +12,7 @@ std::string trimCRLF(const std::string &s) {
 
 bool isValidNick(const std::string &nick) {
     // Very permissive, but avoid spaces and control chars.
-    if (nick.empty()) return false;
+    if (nick.empty() || nick.size() > NICKLEN) return false;
     for (size_t i = 0; i < nick.size(); ++i) {
         unsigned char c = nick[i];
         if (c <= 32 || c == 127 || c == ',' || c == '*') return false;
@@ -20,9 +20,32 @@ static bool parsePort(const char *s, unsigned short &out) {
 }
 
 int main(int argc, char **argv) {
-    // Require: ./ircserv <port> <password>
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <port> <password>\n";
+    // Require: ./ircserv <port> <password> [--name=value ...]
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <port> <password> [options]\n"
+                  << "  --backend=auto|poll|epoll|epoll-et  event backend (default auto)\n"
+                  << "  --shards=N                          event-loop threads for socket I/O (default 1)\n"
+                  << "  --casemapping=rfc1459|ascii         nick/channel case folding (default rfc1459)\n"
+                  << "  --metrics-file=PATH                 write Prometheus metrics to PATH\n"
+                  << "  --metrics-interval=SECONDS          how often (default 10)\n"
+                  << "  --capture=PATH                      record client input (see tools/replay)\n"
+                  << "  --ping-interval=SECONDS             PING silent clients (default 120, 0 = off)\n"
+                  << "  --ping-timeout=SECONDS              then wait this long for input (default 60)\n"
+                  << "  --registration-timeout=SECONDS      to finish PASS/NICK/USER (default 60, 0 = off)\n"
+                  << "  --idle-timeout=SECONDS              drop users without commands (default 0 = off)\n"
+                  << "  --max-clients=N                     connections server-wide (default 0 = no limit)\n"
+                  << "  --max-per-ip=N                      connections per source (default 0 = no limit)\n"
+                  << "  --ip-prefix=BITS                    source = address /BITS (default 32)\n"
+                  << "  --accept-budget=N                   accepts per shard per iteration (default 64)\n"
+                  << "  --backlog=N                         listen() backlog (default 128)\n"
+                  << "  --sendq=BYTES                       unsent output per client (default 1048576)\n"
+                  << "  --sendq-policy=disconnect|drop      when it is full (default disconnect)\n"
+                  << "  --recvq=BYTES                       unprocessed input per client (default 8192)\n"
+                  << "  --recvq-policy=pause|disconnect     when it is full (default pause)\n"
+                  << "  --flood-rate=N                      lines per second per client (default 25, 0 = off)\n"
+                  << "  --flood-burst=N                     lines allowed ahead of the rate (default 50)\n"
+                  << "  --line-budget=N                     lines per client per loop iteration (default 16)\n"
+                  << "  --utf8=any|strict                   strict: drop lines that are not UTF-8 (default any)\n";
         return 1;
     }
     unsigned short port = 0;
@@ -36,13 +59,23 @@ int main(int argc, char **argv) {
         return 1;
     }
 
+    // Optional knobs after the two mandatory arguments.
+    ServerConfig cfg;
+    for (int i = 3; i < argc; ++i) {
+        std::string err;
+        if (!applyConfigArg(cfg, argv[i], err)) {
+            std::cerr << err << "\n";
+            return 1;
+        }
+    }
+
     // Initialize server with a human-readable name.
-    Server srv("ft_irc.min", password);
+    Server srv("ft_irc.min", password, cfg);
     if (!srv.start(port)) {
         std::cerr << "Failed to start server.\n";
         return 1;
     }
-    // Enter the single-poll() loop.
+    // Enter the event loop.
     srv.run();
     return 0;
 }
@@ -0,0 +1,534 @@
+#!/usr/bin/env bash
+# test_protocol.sh — protocol edge cases over nc, one server per section.
+# Usage: ./tests/test_protocol.sh [PORT] [PASSWORD]
+
+set -uo pipefail
+
+PORT="${1:-6667}"
+PASS="${2:-password}"
+HOST="127.0.0.1"
+OUT="./tests/output/protocol"
+mkdir -p "$OUT"
+rm -f "$OUT"/*.txt "$OUT"/*.in "$OUT"/*.fifo "$OUT"/*.paste
+
+SERVER_PID=""
+CLIENT_PIDS=()
+pass=true
+
+stop_server() {
+  for pid in "${CLIENT_PIDS[@]}"; do kill "$pid" >/dev/null 2>&1 || true; done
+  CLIENT_PIDS=()
+  [[ -n "$SERVER_PID" ]] && { kill "$SERVER_PID" >/dev/null 2>&1 || true; wait "$SERVER_PID" 2>/dev/null; }
+  SERVER_PID=""
+}
+trap stop_server EXIT
+
+# Start ircserv with extra options and wait for the port (max ~5s).
+start_server() {
+  stop_server
+  ./ircserv "$PORT" "$PASS" "$@" >>"$OUT/server_output.txt" 2>&1 &
+  SERVER_PID=$!
+  for i in {1..50}; do
+    nc -z -w 1 "$HOST" "$PORT" 2>/dev/null && return 0
+    sleep 0.1
+    if ! kill -0 "$SERVER_PID" 2>/dev/null; then
+      echo "Server crashed; logs:"; tail -n 20 "$OUT/server_output.txt"; exit 1
+    fi
+  done
+  echo "Server didn't open port $PORT in time."; exit 1
+}
+
+# Scripted client: client <outfile> <nick|-> <line>...
+# Registers as <nick> unless it is "-", then sends each line with CRLF
+# (printf %b, so \0, \r and \xHH work). Special lines:
+#   sleep N              pause
+#   raw TEXT             TEXT without the CRLF
+#   paste FILE           FILE as it is
+#   await FILE REGEX     wait (max 10s) until FILE matches REGEX
+# The client does not QUIT: nc stays until the server closes it or the
+# section ends, so a timeout shows up as nc exiting on its own. LAST_PID
+# is that nc.
+client() {
+  local out="$1"; shift
+  spawn_client "$out" "$out" "$@"
+}
+
+# Like client, but nothing reads what the server sends: nc's output goes to a
+# FIFO held open by a process that never reads it, so the server's writes
+# soon block. resume <outfile> <LAST_HOLDER> starts reading it into outfile.
+stalled_client() {
+  local out="$1"; shift
+  rm -f "$out.fifo" && mkfifo "$out.fifo"
+  sleep 60 <"$out.fifo" &
+  LAST_HOLDER=$!
+  CLIENT_PIDS+=("$LAST_HOLDER")
+  spawn_client "$out" "$out.fifo" "$@"
+}
+
+resume() {
+  cat "$1.fifo" >"$1" &
+  CLIENT_PIDS+=($!)
+  sleep 0.1
+  kill "$2" >/dev/null 2>&1
+}
+
+spawn_client() {
+  local out="$1" sink="$2" nick="$3"; shift 3
+  local fifo="$out.in"
+  rm -f "$fifo" && mkfifo "$fifo"
+  nc "$HOST" "$PORT" <"$fifo" >"$sink" 2>&1 &
+  LAST_PID=$!
+  CLIENT_PIDS+=("$LAST_PID")
+  {
+    if [[ "$nick" != "-" ]]; then
+      printf 'PASS %s\r\nNICK %s\r\nUSER %s 0 * :%s\r\n' "$PASS" "$nick" "$nick" "$nick"
+    fi
+    for line in "$@"; do
+      case "$line" in
+        sleep\ *) $line ;;
+        raw\ *)   printf '%b' "${line#raw }" ;;
+        paste\ *) cat "${line#paste }" ;;
+        await\ *) line=${line#await }; wait_for "${line%% *}" "${line#* }" 10 ;;
+        *)        printf '%b\r\n' "$line" ;;
+      esac
+    done
+    exec sleep 30
+  } >"$fifo" &
+  CLIENT_PIDS+=($!)
+}
+
+# True if <file> matches <regex>, CRs stripped. grep -c reads to the end:
+# with -q, tr could die of SIGPIPE and pipefail would fail the match.
+matches() {
+  tr -d '\r' 2>/dev/null <"$1" | grep -Ec -- "$2" >/dev/null
+}
+
+# Wait until <file> matches <regex>, at most <seconds>.
+wait_for() {
+  local file="$1" pat="$2" sec="${3:-5}"
+  for _ in $(seq 1 $((sec * 10))); do
+    matches "$file" "$pat" && return 0
+    sleep 0.1
+  done
+  return 1
+}
+
+expect() {   # expect <file> <regex> <what> [seconds]
+  if wait_for "$1" "$2" "${4:-3}"; then echo "[OK] $3"; else echo "[FAIL] $3 (see $1)"; pass=false; fi
+}
+
+expect_not() {   # expect_not <file> <regex> <what>; call after the file is complete
+  if matches "$1" "$2"; then echo "[FAIL] $3 (see $1)"; pass=false; else echo "[OK] $3"; fi
+}
+
+# Wait until process <pid> is gone, at most <seconds>.
+wait_gone() {
+  local pid="$1" sec="$2"
+  for _ in $(seq 1 $((sec * 10))); do
+    kill -0 "$pid" 2>/dev/null || return 0
+    sleep 0.1
+  done
+  return 1
+}
+
+check() {   # check <what> <command>...; OK if the command succeeds
+  local what="$1"; shift
+  if "$@"; then echo "[OK] $what"; else echo "[FAIL] $what"; pass=false; fi
+}
+
+count() {   # count <file> <regex>: matching lines, CRs stripped
+  tr -d '\r' <"$1" | grep -Ec -- "$2"
+}
+
+# True if the texts of "PRIVMSG <nick> :<prefix>N" lines in <file> are
+# <prefix>0 .. <prefix><n-1>, each once and in order.
+in_order() {
+  local file="$1" nick="$2" prefix="$3" n="$4"
+  diff -q <(tr -d '\r' <"$file" | sed -n "s/^:[^ ]* PRIVMSG $nick :$prefix//p") <(seq 0 $((n - 1))) >/dev/null
+}
+
+now_ms() { date +%s%3N; }
+
+server_alive() {
+  if kill -0 "$SERVER_PID" 2>/dev/null; then echo "[OK] server alive"; else echo "[FAIL] server died"; pass=false; fi
+}
+
+# --- Parser: prefixes, tags, spacing, trailing parameters, too many parameters.
+test_parser() {
+  echo "== parser"
+  start_server
+  client "$OUT/parser_bob.txt" bob "JOIN #p"
+  sleep 0.5
+  client "$OUT/parser_alice.txt" alice \
+    "JOIN #p" \
+    "sleep 0.3" \
+    "PRIVMSG bob :trailing  keeps  spaces  " \
+    ":alice PRIVMSG bob :with prefix" \
+    "@time=1;x=y :ignored.prefix PRIVMSG bob :with tags" \
+    "privmsg    bob     :lower case, extra spaces" \
+    "PRIVMSG bob middle only the first word" \
+    "PRIVMSG bob ::colon first" \
+    "PRIVMSG #p 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20" \
+    "" \
+    "   " \
+    ":only.a.prefix" \
+    "@only=tags" \
+    "PRIVMSG" \
+    "PRIVMSG bob" \
+    "PRIVMSG bob :done"
+  expect "$OUT/parser_bob.txt" 'PRIVMSG bob :done$' "last line delivered"
+  expect "$OUT/parser_bob.txt" 'PRIVMSG bob :trailing  keeps  spaces  $' "trailing parameter keeps its spaces"
+  expect "$OUT/parser_bob.txt" '^:alice!\S+ PRIVMSG bob :with prefix$' "client prefix is ignored"
+  expect "$OUT/parser_bob.txt" '^:alice!\S+ PRIVMSG bob :with tags$' "tags and a foreign prefix are skipped"
+  expect "$OUT/parser_bob.txt" 'PRIVMSG bob :lower case, extra spaces$' "lower-case command, repeated spaces"
+  expect "$OUT/parser_bob.txt" 'PRIVMSG bob :middle$' "middle parameter is one word"
+  expect "$OUT/parser_bob.txt" 'PRIVMSG bob ::colon first$' "only the first ':' starts the trailing parameter"
+  expect "$OUT/parser_bob.txt" 'PRIVMSG #p :3$' "more than 15 parameters are accepted"
+  expect "$OUT/parser_alice.txt" ' 461 alice PRIVMSG ' "too few parameters: 461"
+  server_alive
+}
+
+# --- NAMES on JOIN: a long member list is cut into several 353 lines.
+test_names() {
+  echo "== names"
+  start_server
+  # 30-character nicks (NICKLEN), enough of them for several lines.
+  local n=45 i nicks=()
+  for i in $(seq 0 $((n - 1))); do nicks+=("$(printf 'member%024d' "$i")"); done
+  # The changes wait until everyone has joined. MODE has no reply: the
+  # operator's NICK after it shows it has run.
+  local first="$OUT/names_${nicks[0]}.txt"
+  local joined="await $first ^:${nicks[$((n - 1))]}!\\S+ JOIN :?#names$"
+  client "$first" "${nicks[0]}" "JOIN #names" "$joined" \
+    "MODE #names +o ${nicks[7]}" "NICK renamed000000000000000000000"
+  sleep 0.5
+  for i in $(seq 1 $((n - 1))); do
+    case $i in
+      5) client "$OUT/names_${nicks[$i]}.txt" "${nicks[$i]}" "JOIN #names" "$joined" "NICK renamed000000000000000000005" ;;
+      9) client "$OUT/names_${nicks[$i]}.txt" "${nicks[$i]}" "JOIN #names" "$joined" "PART #names" ;;
+      *) client "$OUT/names_${nicks[$i]}.txt" "${nicks[$i]}" "JOIN #names" ;;
+    esac
+  done
+  expect "$first" "NICK :?renamed000000000000000000000$" "member opped, operator renamed" 15
+  expect "$first" "NICK :?renamed000000000000000000005$" "member renamed"
+  expect "$first" "^:${nicks[9]}!\\S+ PART " "member parted"
+  local late
+  late=$(printf 'latecomer%021d' 0)
+  client "$OUT/names_late.txt" "$late" "JOIN #names"
+  expect "$OUT/names_late.txt" ' 366 ' "names complete"
+  local lines
+  lines=$(count "$OUT/names_late.txt" ' 353 ')
+  check "several 353 lines ($lines)" test "$lines" -ge 3
+  # Each line as sent, CRLF included.
+  check "every 353 line fits in 512 bytes" \
+    awk '/ 353 / && length($0) + 1 > 512 { bad = 1 } END { exit bad }' "$OUT/names_late.txt"
+  local want=("@renamed000000000000000000000" "renamed000000000000000000005" "@${nicks[7]}" "$late")
+  for i in $(seq 1 $((n - 1))); do
+    case $i in 5|7|9) ;; *) want+=("${nicks[$i]}") ;; esac
+  done
+  check "names are the members, each once" diff \
+    <(tr -d '\r' <"$OUT/names_late.txt" | sed -n 's/^[^ ]* 353 [^ ]* = #names ://p' | tr ' ' '\n' | sort) \
+    <(printf '%s\n' "${want[@]}" | sort)
+  server_alive
+}
+
+# --- Casemapping: nicks and channel names that differ only in case collide.
+test_casemap() {
+  echo "== casemapping rfc1459"
+  start_server
+  client "$OUT/case_dan.txt" "Dan[x]^" "JOIN #Room[1]"
+  sleep 0.5
+  client "$OUT/case_eve.txt" "dAN{X}~" \
+    "sleep 0.3" \
+    "NICK eve" \
+    "JOIN #rOOM{1}" \
+    "PRIVMSG #ROOM{1} :to the channel" \
+    "PRIVMSG DAN{X}~ :to the nick"
+  expect "$OUT/case_eve.txt" ' 433 \* dAN\{X\}~ ' "nick differing in case and []^ vs {}~: 433"
+  expect "$OUT/case_eve.txt" ' 001 eve ' "registers with another nick"
+  expect "$OUT/case_dan.txt" '^:eve!\S+ JOIN ' "JOIN under another case reaches the members"
+  expect "$OUT/case_dan.txt" 'PRIVMSG #Room\[1\] :to the channel$' "channel found under another case"
+  expect "$OUT/case_dan.txt" 'PRIVMSG Dan\[x\]\^ :to the nick$' "nick found under another case"
+
+  echo "== casemapping ascii"
+  start_server --casemapping=ascii
+  client "$OUT/ascii_dan.txt" "dan[x]" "JOIN #r[1]"
+  sleep 0.5
+  client "$OUT/ascii_eve.txt" "dan{x}" "JOIN #r{1}" "JOIN #R[1]"
+  sleep 0.5
+  client "$OUT/ascii_bob.txt" "DAN[X]"
+  expect "$OUT/ascii_eve.txt" ' 001 dan\{x\} ' "{} are not the lower case of []"
+  expect "$OUT/ascii_bob.txt" ' 433 \* DAN\[X\] ' "A-Z still fold"
+  expect "$OUT/ascii_dan.txt" '^:dan\{x\}!\S+ JOIN :?#R\[1\]$' "#R[1] is #r[1]"
+  expect_not "$OUT/ascii_dan.txt" 'JOIN :?#r\{1\}$' "#r{1} is another channel"
+  server_alive
+}
+
+# --- Timeouts: registration deadline, keepalive PING, ping timeout.
+test_timeouts() {
+  echo "== timeouts"
+  start_server --registration-timeout=1 --ping-interval=1 --ping-timeout=1
+  local keep=("JOIN #t")
+  for _ in {1..8}; do keep+=("sleep 0.5" "PONG :ft_irc.min"); done
+  client "$OUT/timeout_busy.txt" busy "${keep[@]}"
+  local busy=$LAST_PID
+  client "$OUT/timeout_silent.txt" silent "JOIN #t"
+  local silent=$LAST_PID
+  client "$OUT/timeout_unreg.txt" - "PASS $PASS" "NICK unreg"
+  local unreg=$LAST_PID
+  sleep 0.5
+  if kill -0 "$unreg" 2>/dev/null; then echo "[OK] unregistered client kept before the deadline"
+  else echo "[FAIL] unregistered client dropped early"; pass=false; fi
+  if wait_gone "$unreg" 3; then echo "[OK] unregistered client dropped after --registration-timeout"
+  else echo "[FAIL] unregistered client still connected"; pass=false; fi
+  expect "$OUT/timeout_silent.txt" '^PING :' "silent user gets a keepalive PING"
+  if wait_gone "$silent" 4; then echo "[OK] silent user dropped after --ping-timeout"
+  else echo "[FAIL] silent user still connected"; pass=false; fi
+  expect "$OUT/timeout_busy.txt" '^:silent!\S+ QUIT :Ping timeout$' "channel sees QUIT :Ping timeout"
+  if kill -0 "$busy" 2>/dev/null; then echo "[OK] user who answers stays connected"
+  else echo "[FAIL] user who answers was dropped"; pass=false; fi
+  server_alive
+}
+
+# --- PRIVMSG/NOTICE targets: TARGMAX, one copy per recipient, NOTICE stays quiet.
+test_relay() {
+  echo "== message targets"
+  start_server
+  client "$OUT/relay_amy.txt" amy "JOIN #a" "JOIN #b"
+  sleep 0.5
+  local many="amy" i
+  for i in $(seq 1 20); do many="$many,t$i"; done
+  client "$OUT/relay_sam.txt" sam \
+    "JOIN #a" \
+    "JOIN #b" \
+    "sleep 0.3" \
+    "PRIVMSG #a,#b :both channels" \
+    "PRIVMSG amy,AMY,amy :named twice" \
+    "PRIVMSG #b,amy :channel and nick" \
+    "PRIVMSG $many :too many" \
+    "PRIVMSG sam :to myself" \
+    "PING :before" \
+    "NOTICE amy" \
+    "NOTICE" \
+    "NOTICE #nowhere :x" \
+    "NOTICE nobody :x" \
+    "PING :after" \
+    "PRIVMSG amy :last"
+  expect "$OUT/relay_sam.txt" ' 005 sam .* TARGMAX=PRIVMSG:20,NOTICE:20( |$)' "TARGMAX in 005"
+  expect "$OUT/relay_amy.txt" 'PRIVMSG amy :last$' "last line delivered"
+  check "one copy across two channels" test "$(count "$OUT/relay_amy.txt" ' :both channels$')" -eq 1
+  expect "$OUT/relay_amy.txt" 'PRIVMSG #a :both channels$' "addressed to the first channel"
+  check "one copy for a nick named twice" test "$(count "$OUT/relay_amy.txt" ' :named twice$')" -eq 1
+  check "one copy for a channel and a nick" test "$(count "$OUT/relay_amy.txt" ' :channel and nick$')" -eq 1
+  expect "$OUT/relay_sam.txt" ' 407 sam ' "21 targets: 407"
+  expect_not "$OUT/relay_amy.txt" ':too many$' "nothing sent past TARGMAX"
+  expect "$OUT/relay_sam.txt" '^:sam!\S+ PRIVMSG sam :to myself$' "a message to oneself comes back"
+  expect_not "$OUT/relay_sam.txt" 'PRIVMSG #[ab] :' "channel messages not echoed"
+  expect "$OUT/relay_sam.txt" 'PONG .*:?after$' "NOTICE run"
+  sed -n '/PONG .*:\{0,1\}before/,/PONG .*:\{0,1\}after/p' "$OUT/relay_sam.txt" >"$OUT/relay_notice.txt"
+  expect_not "$OUT/relay_notice.txt" ' [0-9]{3} ' "NOTICE errors, too few parameters included: no numeric"
+  server_alive
+}
+
+# Write <n> channel lines of about 420 bytes to <file>, for "paste".
+make_paste() {
+  awk -v chan="$2" -v n="$3" 'BEGIN {
+    pad = sprintf("%400s", ""); gsub(/ /, "x", pad)
+    for (i = 0; i < n; i++) printf "PRIVMSG %s :%d %s\r\n", chan, i, pad
+  }' >"$1"
+}
+
+# --- Send and receive queues: a reader that stops reading is dropped, or with
+# --sendq-policy=drop loses channel traffic but keeps its private replies; a
+# peer that never ends its line is dropped; a paste over --recvq waits.
+# The kernel buffers a few MB for a stalled reader before --sendq sees any of
+# it, hence the 6 MB pastes.
+test_queues() {
+  # Private lines as long as the channel ones, so they cannot slip into the
+  # slack a full queue has left.
+  local pad
+  pad=$(printf 'z%.0s' {1..400})
+  make_paste "$OUT/busy.paste" "#busy" 15000
+
+  echo "== sendq, disconnect"
+  start_server --sendq=65536 --flood-rate=0
+  stalled_client "$OUT/sendq_slow.txt" slow "JOIN #busy"
+  client "$OUT/sendq_watch.txt" watch "JOIN #busy"
+  sleep 0.5
+  client "$OUT/sendq_talker.txt" talker "JOIN #busy" "paste $OUT/busy.paste"
+  expect "$OUT/sendq_watch.txt" '^:slow!\S+ QUIT :SendQ exceeded$' "reader that stopped reading dropped" 20
+  expect_not "$OUT/sendq_watch.txt" '^:(watch|talker)!\S+ QUIT' "readers that keep up stay"
+  server_alive
+
+  local shards
+  for shards in 1 2; do
+    echo "== sendq, drop, --shards=$shards"
+    start_server --sendq=65536 --sendq-policy=drop --flood-rate=0 --shards=$shards
+    # The private lines go out once a paste has filled the slow reader's queue,
+    # and a second paste follows them: the drop policy must make room for them
+    # and must not later take them for channel traffic.
+    local pasted="await $OUT/drop${shards}_talker.txt PONG .*:?pasted$"
+    stalled_client "$OUT/drop${shards}_slow.txt" slow "JOIN #busy" "$pasted" "PING :mine$pad"
+    local slow=$LAST_PID holder=$LAST_HOLDER
+    client "$OUT/drop${shards}_watch.txt" watch "JOIN #busy"
+    sleep 0.5
+    # Several senders, so with two shards some sit on the other one.
+    local i sent=()
+    for i in 1 2 3 4; do
+      client "$OUT/drop${shards}_dm$i.txt" "dm$i" "$pasted" "PRIVMSG slow :dm$i $pad" "PING :sent"
+      sent+=("await $OUT/drop${shards}_dm$i.txt PONG .*:?sent$")
+    done
+    client "$OUT/drop${shards}_talker.txt" talker "JOIN #busy" \
+      "paste $OUT/busy.paste" "PING :pasted" "${sent[@]}" "sleep 0.2" \
+      "paste $OUT/busy.paste" "PING :again" "STATS p"
+    expect "$OUT/drop${shards}_talker.txt" 'PONG .*:?again$' "two pastes run" 30
+    expect "$OUT/drop${shards}_talker.txt" ' dropped [1-9][0-9]* ' "channel traffic dropped (STATS p)"
+    resume "$OUT/drop${shards}_slow.txt" "$holder"
+    expect "$OUT/drop${shards}_slow.txt" "PONG .*:?mine$pad\$" "own reply delivered" 10
+    for i in 1 2 3 4; do
+      expect "$OUT/drop${shards}_slow.txt" "PRIVMSG slow :dm$i $pad\$" "private message $i delivered" 1
+    done
+    check "slow reader still connected" kill -0 "$slow"
+    expect_not "$OUT/drop${shards}_watch.txt" ' QUIT ' "nobody dropped"
+    server_alive
+  done
+
+  echo "== recvq"
+  start_server
+  client "$OUT/recvq_watch.txt" watch "JOIN #q"
+  sleep 0.5
+  client "$OUT/recvq_endless.txt" endless "JOIN #q" "sleep 0.3" "raw PRIVMSG #q :$(printf 'y%.0s' {1..9000})"
+  local endless=$LAST_PID
+  expect "$OUT/recvq_watch.txt" '^:endless!\S+ QUIT :RecvQ exceeded$' "line longer than --recvq dropped"
+  check "its connection closed" wait_gone "$endless" 3
+
+  echo "== recvq, pause"
+  start_server --recvq=1024 --recvq-policy=pause --flood-rate=0
+  client "$OUT/pause_watch.txt" watch
+  sleep 0.5
+  local paste="PRIVMSG watch :p0"
+  for i in {1..199}; do paste+="\r\nPRIVMSG watch :p$i"; done
+  client "$OUT/pause_talker.txt" talker "sleep 0.3" "$paste" "STATS p"
+  expect "$OUT/pause_watch.txt" 'PRIVMSG watch :p199$' "paste over --recvq runs to the end"
+  check "lines arrive in order, none dropped" in_order "$OUT/pause_watch.txt" watch p 200
+  expect "$OUT/pause_talker.txt" ' recvq 0 peak (10[0-2][0-9]|[0-9]{1,3})$' "receive queue stayed within --recvq"
+  server_alive
+}
+
+# --- Flood control: a paste past --flood-burst runs the burst at once, then
+# the rest in order at --flood-rate, while other clients are served; and
+# --line-budget spreads a paste over loop iterations without losing lines.
+test_flood() {
+  echo "== flood control"
+  start_server --flood-rate=10 --flood-burst=5
+  client "$OUT/flood_watch.txt" watch
+  sleep 0.5
+  # One argument, so the paste reaches the server in one write; the pause lets
+  # the clock forget the three registration lines.
+  local paste="PRIVMSG watch :n0"
+  for i in {1..24}; do paste+="\r\nPRIVMSG watch :n$i"; done
+  client "$OUT/flood_talker.txt" talker "sleep 1" "$paste" "STATS p"
+  client "$OUT/flood_pinger.txt" pinger "sleep 1.5" "PING :during"
+  wait_for "$OUT/flood_watch.txt" 'PRIVMSG watch :n0$' 3
+  local t0 first
+  t0=$(now_ms)
+  # Lines 100 ms apart are paced; the burst may still be coming in.
+  sleep 0.05
+  first=$(count "$OUT/flood_watch.txt" 'PRIVMSG watch :n')
+  # --flood-burst lines ahead of the clock, plus the one that moves it there.
+  check "burst of 6 delivered at once (got $first)" test "$first" -ge 5 -a "$first" -le 8
+  expect "$OUT/flood_pinger.txt" 'PONG .*:?during$' "another client is answered meanwhile" 2
+  check "paste still running when the PONG came" test "$(count "$OUT/flood_watch.txt" 'PRIVMSG watch :n')" -lt 25
+  expect "$OUT/flood_watch.txt" 'PRIVMSG watch :n24$' "all 25 lines delivered" 5
+  local ms=$(( $(now_ms) - t0 ))
+  # 25 - $first lines at 10 per second.
+  check "rest arrive at --flood-rate (${ms} ms for $((25 - first)) lines)" \
+    test "$ms" -ge $(( (25 - first) * 70 )) -a "$ms" -le $(( (25 - first) * 130 + 300 ))
+  check "lines arrive in order, none dropped" in_order "$OUT/flood_watch.txt" watch n 25
+  expect "$OUT/flood_talker.txt" ' throttled [1-9][0-9]* ' "STATS p counts throttled rounds"
+
+  # A rate that does not divide 1000: whole-millisecond costs ran it at 1000/s.
+  echo "== flood control, 600 lines/s"
+  start_server --flood-rate=600 --flood-burst=10
+  client "$OUT/flood600_watch.txt" watch
+  sleep 0.5
+  paste="PRIVMSG watch :r0"
+  for i in {1..610}; do paste+="\r\nPRIVMSG watch :r$i"; done
+  client "$OUT/flood600_talker.txt" talker "sleep 1" "$paste"
+  wait_for "$OUT/flood600_watch.txt" 'PRIVMSG watch :r0$' 3
+  t0=$(now_ms)
+  first=$(count "$OUT/flood600_watch.txt" 'PRIVMSG watch :r')
+  expect "$OUT/flood600_watch.txt" 'PRIVMSG watch :r610$' "all 611 lines delivered" 5
+  ms=$(( $(now_ms) - t0 ))
+  check "rest arrive at 600/s (${ms} ms for $((611 - first)) lines)" \
+    test "$ms" -ge $(( (611 - first) * 1000 / 600 * 85 / 100 )) -a "$ms" -le $(( (611 - first) * 1000 / 600 * 120 / 100 + 200 ))
+  check "lines arrive in order, none dropped" in_order "$OUT/flood600_watch.txt" watch r 611
+
+  echo "== line budget"
+  start_server --flood-rate=0 --line-budget=4
+  client "$OUT/budget_watch.txt" watch
+  sleep 0.5
+  paste="PRIVMSG watch :b0"
+  for i in {1..199}; do paste+="\r\nPRIVMSG watch :b$i"; done
+  client "$OUT/budget_talker.txt" talker "sleep 0.3" "$paste" "STATS p"
+  expect "$OUT/budget_watch.txt" 'PRIVMSG watch :b199$' "all 200 lines delivered"
+  check "lines arrive in order, none dropped" in_order "$OUT/budget_watch.txt" watch b 200
+  expect "$OUT/budget_talker.txt" ' deferred [1-9][0-9]*$' "STATS p counts deferred rounds"
+  server_alive
+}
+
+# --- Malformed lines: NUL, bare CR and (with --utf8=strict) bad UTF-8 drop the
+# whole line; the lines around them still run. The long lines put the bad byte
+# past the first vector block.
+test_malformed() {
+  local pad
+  pad=$(printf 'x%.0s' {1..100})
+  echo "== malformed lines"
+  start_server
+  client "$OUT/bad_bob.txt" bob
+  sleep 0.5
+  client "$OUT/bad_alice.txt" alice \
+    "sleep 0.3" \
+    "PRIVMSG bob :before" \
+    "PRIVMSG bob :nul\0inside" \
+    "PRIVMSG bob :$pad\0nul-far" \
+    "PRIVMSG bob :bare\rcr" \
+    "PRIVMSG bob :$pad\rcr-far" \
+    "PRIVMSG bob :latin1 \xe9" \
+    "PRIVMSG bob :after" \
+    "STATS p"
+  expect "$OUT/bad_bob.txt" 'PRIVMSG bob :after$' "line after the malformed ones runs"
+  expect "$OUT/bad_bob.txt" 'PRIVMSG bob :before$' "line before them runs"
+  expect_not "$OUT/bad_bob.txt" 'inside|nul-far' "lines with NUL dropped"
+  expect_not "$OUT/bad_bob.txt" 'cr$|cr-far' "lines with a bare CR dropped"
+  expect "$OUT/bad_bob.txt" 'PRIVMSG bob :latin1 ' "--utf8=any keeps non-UTF-8 text"
+  expect "$OUT/bad_alice.txt" ' malformed 4 ' "STATS p counts 4 malformed lines"
+
+  echo "== malformed lines, --utf8=strict"
+  start_server --utf8=strict
+  client "$OUT/strict_bob.txt" bob
+  sleep 0.5
+  client "$OUT/strict_alice.txt" alice \
+    "sleep 0.3" \
+    "PRIVMSG bob :latin1 \xe9" \
+    "PRIVMSG bob :$pad overlong \xc0\xaf" \
+    "PRIVMSG bob :cut \xe2\x82" \
+    "PRIVMSG bob :utf8 \xc3\xa9 \xe2\x82\xac" \
+    "PRIVMSG bob :after"
+  expect "$OUT/strict_alice.txt" ' 005 alice .*UTF8ONLY' "UTF8ONLY advertised"
+  expect "$OUT/strict_bob.txt" 'PRIVMSG bob :after$' "line after the malformed ones runs"
+  expect "$OUT/strict_bob.txt" $'PRIVMSG bob :utf8 \xc3\xa9 \xe2\x82\xac$' "valid UTF-8 kept"
+  expect_not "$OUT/strict_bob.txt" 'latin1|overlong|cut' "invalid UTF-8 dropped"
+  server_alive
+}
+
+test_parser
+test_names
+test_casemap
+test_timeouts
+test_relay
+test_queues
+test_flood
+test_malformed
+
+$pass && echo "All checks passed." || { echo "Some checks failed. See $OUT/"; exit 1; }
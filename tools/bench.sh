@@ -0,0 +1,32 @@
+#!/usr/bin/env bash
+# bench.sh — standard load scenarios against ./ircserv on loopback.
+# One JSON line per scenario on stdout, also appended to tests/output/bench.jsonl.
+# Scale with BENCH_CLIENTS / BENCH_DURATION; pass server options in SERVER_OPTS
+# (e.g. SERVER_OPTS="--shards=4 --backend=epoll-et").
+
+set -euo pipefail
+
+PORT="${BENCH_PORT:-$((20000 + RANDOM % 20000))}"
+PASS="benchpw"
+CLIENTS="${BENCH_CLIENTS:-2000}"
+DURATION="${BENCH_DURATION:-5}"
+OUT="./tests/output"
+mkdir -p "$OUT"
+
+# Both ends need far more than the default 1024 descriptors.
+ulimit -n "$(ulimit -Hn)" 2>/dev/null || true
+
+./ircserv "$PORT" "$PASS" ${SERVER_OPTS:-} >"$OUT/bench_server.txt" 2>&1 &
+SERVER_PID=$!
+trap 'kill $SERVER_PID >/dev/null 2>&1 || true' EXIT
+sleep 0.5
+
+run() {
+  ./loadgen --port="$PORT" --pass="$PASS" --duration="$DURATION" "$@" | tee -a "$OUT/bench.jsonl"
+  sleep 1 # let the server finish closing the previous run's clients
+}
+
+run --label=dm       --scenario=dm    --clients="$CLIENTS" --rate=20000
+run --label=rooms10  --scenario=rooms --clients="$CLIENTS" --room-size=10 --rate=5000
+run --label=mega     --scenario=mega  --clients="$CLIENTS" --senders=10 --rate=200
+run --label=churn    --scenario=churn --clients=200
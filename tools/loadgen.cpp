@@ -0,0 +1,403 @@
+// loadgen.cpp — multi-connection load generator for ircserv (Linux, epoll).
+// Opens many clients, registers them, joins them to channels laid out by the
+// scenario and sends PRIVMSG at a fixed total rate. Every message carries its
+// send time (CLOCK_MONOTONIC, same host), so receivers measure delivery
+// latency. Prints one JSON object per run on stdout; progress goes to stderr.
+//
+//   ./loadgen --port=6667 --pass=pw --scenario=rooms --clients=2000 --room-size=10
+//             --rate=5000 --duration=5
+//
+// Scenarios:
+//   dm     clients in pairs, each messages its partner
+//   rooms  channels of --room-size members, each member messages its room
+//   mega   everyone in one channel, --senders of them talk
+//   churn  --clients loops of connect, register, JOIN, QUIT (no PRIVMSG)
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+
+namespace {
+
+unsigned long nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000000000UL + (unsigned long)ts.tv_nsec;
+}
+
+// Log-linear histogram: 16 sub-buckets per power of two (about 6% resolution),
+// enough for p999 without keeping every sample.
+struct LatencyHist {
+    enum { SUB = 16, BUCKETS = 64 * SUB };
+    std::vector<unsigned long> b;
+    unsigned long n;
+    LatencyHist() : b(BUCKETS, 0), n(0) {}
+    static size_t index(unsigned long v) {
+        if (v < SUB) return v;
+        int top = 63 - __builtin_clzl(v);           // >= 4
+        size_t sub = (v >> (top - 4)) & (SUB - 1);
+        return (size_t)(top - 3) * SUB + sub;
+    }
+    static unsigned long upper(size_t i) {
+        if (i < SUB) return i;
+        size_t top = i / SUB + 3, sub = i % SUB;
+        return ((SUB + sub + 1) << (top - 4)) - 1;
+    }
+    void add(unsigned long v) { ++b[index(v)]; ++n; }
+    unsigned long quantile(double q) const {
+        if (!n) return 0;
+        unsigned long rank = (unsigned long)(q * (n - 1)), seen = 0;
+        for (size_t i = 0; i < b.size(); ++i) {
+            seen += b[i];
+            if (seen > rank) return upper(i);
+        }
+        return 0;
+    }
+};
+
+struct Options {
+    std::string host, pass, scenario, label;
+    int port;
+    size_t clients, roomSize, senders, size, inflight;
+    double rate, duration, drain;
+    Options() : host("127.0.0.1"), pass("pw"), scenario("rooms"), port(6667), clients(1000),
+                roomSize(10), senders(0), size(64), inflight(256), rate(1000), duration(5), drain(2) {}
+};
+
+enum State { CONNECTING, REGISTERING, JOINING, READY, QUITTING, DONE };
+
+struct Conn {
+    int         fd;
+    State       state;
+    std::string nick;
+    std::string channel;   // joined channel, if any
+    std::string target;    // where its PRIVMSGs go
+    std::string in, out;
+    bool        pollOut;
+    unsigned long started; // churn: start of the current cycle
+    Conn() : fd(-1), state(DONE), pollOut(false), started(0) {}
+};
+
+Options opt;
+int ep = -1;
+std::vector<Conn> conns;
+unsigned long serial = 0;        // nick uniqueness across reconnects
+size_t registered = 0, joined = 0, closedEarly = 0, errors = 0;
+unsigned long sent = 0, received = 0;
+unsigned long bytesOut = 0, bytesIn = 0;
+unsigned long cycles = 0;
+LatencyHist lat;
+
+bool parseArg(const std::string &a) {
+    size_t eq = a.find('=');
+    if (a.compare(0, 2, "--") != 0 || eq == std::string::npos) return false;
+    std::string k = a.substr(2, eq - 2), v = a.substr(eq + 1);
+    if (k == "host") opt.host = v;
+    else if (k == "port") opt.port = std::atoi(v.c_str());
+    else if (k == "pass") opt.pass = v;
+    else if (k == "scenario") opt.scenario = v;
+    else if (k == "label") opt.label = v;
+    else if (k == "clients") opt.clients = std::strtoul(v.c_str(), 0, 10);
+    else if (k == "room-size") opt.roomSize = std::strtoul(v.c_str(), 0, 10);
+    else if (k == "senders") opt.senders = std::strtoul(v.c_str(), 0, 10);
+    else if (k == "size") opt.size = std::strtoul(v.c_str(), 0, 10);
+    else if (k == "inflight") opt.inflight = std::strtoul(v.c_str(), 0, 10);
+    else if (k == "rate") opt.rate = std::atof(v.c_str());
+    else if (k == "duration") opt.duration = std::atof(v.c_str());
+    else if (k == "drain") opt.drain = std::atof(v.c_str());
+    else return false;
+    return true;
+}
+
+void watch(Conn &c, size_t idx, bool add) {
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | (c.pollOut ? (unsigned)EPOLLOUT : 0u);
+    ev.data.u64 = idx;
+    epoll_ctl(ep, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, c.fd, &ev);
+}
+
+void flush(Conn &c, size_t idx) {
+    while (!c.out.empty()) {
+        ssize_t n = ::send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+        if (n <= 0) break;
+        bytesOut += n;
+        c.out.erase(0, n);
+    }
+    bool want = !c.out.empty();
+    if (want != c.pollOut) {
+        c.pollOut = want;
+        watch(c, idx, false);
+    }
+}
+
+void queue(Conn &c, size_t idx, const std::string &s) {
+    c.out += s;
+    flush(c, idx);
+}
+
+bool connectOne(Conn &c, size_t idx) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) { std::perror("socket"); return false; }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct sockaddr_in a;
+    std::memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_port = htons(opt.port);
+    inet_pton(AF_INET, opt.host.c_str(), &a.sin_addr);
+    if (::connect(fd, (struct sockaddr *)&a, sizeof(a)) < 0 && errno != EINPROGRESS) {
+        std::perror("connect");
+        ::close(fd);
+        return false;
+    }
+    c.fd = fd;
+    c.state = CONNECTING;
+    c.in.clear();
+    c.out.clear();
+    c.pollOut = true;
+    c.started = nowNs();
+    std::ostringstream nick;
+    nick << opt.scenario.substr(0, 2) << ++serial;
+    c.nick = nick.str();
+    watch(c, idx, true);
+    c.out = "PASS " + opt.pass + "\r\nNICK " + c.nick + "\r\nUSER " + c.nick + " 0 * :loadgen\r\n";
+    return true;
+}
+
+void shut(Conn &c) {
+    if (c.fd >= 0) ::close(c.fd);
+    c.fd = -1;
+    c.state = DONE;
+}
+
+// Where client i goes in the scenario's topology.
+void layout(size_t i) {
+    Conn &c = conns[i];
+    std::ostringstream ch;
+    if (opt.scenario == "dm") {
+        c.channel.clear();
+    } else if (opt.scenario == "rooms") {
+        ch << "#room" << i / (opt.roomSize ? opt.roomSize : 1);
+        c.channel = ch.str();
+    } else {
+        c.channel = opt.scenario == "mega" ? "#mega" : "#churn";
+    }
+}
+
+void onLine(Conn &c, size_t idx, const char *l, size_t n) {
+    std::string line(l, n);
+    if (line.compare(0, 5, "PING ") == 0) { queue(c, idx, "PONG " + line.substr(5) + "\r\n"); return; }
+    size_t sp = line.find(' ');
+    if (sp == std::string::npos) return;
+    std::string rest = line.substr(sp + 1);
+    if (rest.compare(0, 8, "PRIVMSG ") == 0) {
+        size_t t = line.find(":t=", sp);
+        if (t != std::string::npos) {
+            unsigned long ts = std::strtoul(line.c_str() + t + 3, 0, 10);
+            unsigned long now = nowNs();
+            lat.add(now > ts ? now - ts : 0);
+            ++received;
+        }
+    } else if (rest.compare(0, 4, "001 ") == 0 && c.state == REGISTERING) {
+        ++registered;
+        if (c.channel.empty()) { c.state = READY; ++joined; }
+        else { c.state = JOINING; queue(c, idx, "JOIN " + c.channel + "\r\n"); }
+    } else if (rest.compare(0, 4, "366 ") == 0 && c.state == JOINING) {
+        c.state = READY;
+        ++joined;
+        if (opt.scenario == "churn") {
+            lat.add(nowNs() - c.started);
+            ++cycles;
+            c.state = QUITTING;
+            queue(c, idx, "QUIT :bye\r\n");
+        }
+    } else if (rest.compare(0, 4, "433 ") == 0 || rest.compare(0, 4, "464 ") == 0) {
+        ++errors;
+    }
+}
+
+void onEvent(size_t idx, unsigned events) {
+    Conn &c = conns[idx];
+    if (c.fd < 0) return;
+    if (c.state == CONNECTING && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err) { ++errors; shut(c); return; }
+        c.state = REGISTERING;
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        char buf[65536];
+        for (;;) {
+            ssize_t n = ::recv(c.fd, buf, sizeof(buf), 0);
+            if (n > 0) {
+                bytesIn += n;
+                c.in.append(buf, n);
+                continue;
+            }
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                if (c.state != QUITTING) ++closedEarly;
+                shut(c);
+                return;
+            }
+            break;
+        }
+        size_t start = 0, nl;
+        while ((nl = c.in.find('\n', start)) != std::string::npos) {
+            size_t end = nl > start && c.in[nl - 1] == '\r' ? nl - 1 : nl;
+            onLine(c, idx, c.in.data() + start, end - start);
+            start = nl + 1;
+        }
+        c.in.erase(0, start);
+    }
+    if (c.fd >= 0 && (events & EPOLLOUT)) flush(c, idx);
+}
+
+void pump(int timeoutMs) {
+    struct epoll_event evs[1024];
+    int n = epoll_wait(ep, evs, 1024, timeoutMs);
+    for (int i = 0; i < n; ++i) onEvent((size_t)evs[i].data.u64, evs[i].events);
+}
+
+// Connect everyone, at most opt.inflight registrations at a time (the
+// server's listen backlog is small).
+bool setup() {
+    size_t next = 0;
+    unsigned long deadline = nowNs() + 60UL * 1000000000UL;
+    while (joined + closedEarly < conns.size()) {
+        while (next < conns.size() && next - joined - closedEarly < opt.inflight) {
+            layout(next);
+            if (!connectOne(conns[next], next)) return false;
+            ++next;
+        }
+        pump(10);
+        if (nowNs() > deadline) { std::cerr << "setup timed out\n"; return false; }
+    }
+    return closedEarly == 0;
+}
+
+void pickTargets() {
+    for (size_t i = 0; i < conns.size(); ++i) {
+        Conn &c = conns[i];
+        if (opt.scenario == "dm") c.target = conns[(i ^ 1) < conns.size() ? (i ^ 1) : i].nick;
+        else c.target = c.channel;
+    }
+}
+
+// Deliveries one message should produce.
+size_t fanout(size_t i) {
+    if (opt.scenario == "dm") return (i ^ 1) < conns.size() ? 1 : 0;
+    if (opt.scenario == "mega") return conns.size() - 1;
+    size_t room = i / opt.roomSize, lo = room * opt.roomSize;
+    size_t hi = lo + opt.roomSize < conns.size() ? lo + opt.roomSize : conns.size();
+    return hi - lo - 1;
+}
+
+void runTraffic(unsigned long &expected) {
+    size_t senders = opt.senders && opt.senders < conns.size() ? opt.senders : conns.size();
+    std::string pad(opt.size > 32 ? opt.size - 32 : 0, 'x');
+    unsigned long t0 = nowNs(), end = t0 + (unsigned long)(opt.duration * 1e9);
+    size_t rr = 0;
+    for (unsigned long now = t0; now < end; now = nowNs()) {
+        unsigned long due = (unsigned long)((now - t0) / 1e9 * opt.rate);
+        for (; sent < due; ++sent) {
+            size_t i = rr++ % senders;
+            Conn &c = conns[i];
+            if (c.fd < 0) continue;
+            char ts[32];
+            snprintf(ts, sizeof(ts), "%lu", nowNs());
+            queue(c, i, "PRIVMSG " + c.target + " :t=" + ts + " " + pad + "\r\n");
+            expected += fanout(i);
+        }
+        pump(1);
+    }
+}
+
+void runChurn(double seconds) {
+    // Every worker loops; when the server closes a QUIT connection, start over.
+    for (size_t i = 0; i < conns.size(); ++i) { layout(i); connectOne(conns[i], i); }
+    unsigned long end = nowNs() + (unsigned long)(seconds * 1e9);
+    while (nowNs() < end) {
+        pump(5);
+        for (size_t i = 0; i < conns.size(); ++i)
+            if (conns[i].fd < 0) connectOne(conns[i], i);
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        if (!parseArg(argv[i])) {
+            std::cerr << "usage: " << argv[0] << " [--host=IP] [--port=N] [--pass=PW]"
+                      << " [--scenario=dm|rooms|mega|churn] [--clients=N] [--room-size=N]"
+                      << " [--senders=N] [--rate=MSG/S] [--duration=S] [--size=BYTES]"
+                      << " [--inflight=N] [--drain=S] [--label=NAME]\n";
+            return 2;
+        }
+    }
+    if (opt.roomSize == 0) opt.roomSize = 1;
+    signal(SIGPIPE, SIG_IGN);
+    // Tens of thousands of sockets: lift the soft fd limit as far as allowed.
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    ep = epoll_create(1024);
+    if (ep < 0) { std::perror("epoll_create"); return 1; }
+    conns.resize(opt.clients);
+
+    unsigned long expected = 0;
+    unsigned long t0 = nowNs();
+    double elapsed = 0;
+    bool ok = true;
+    if (opt.scenario == "churn") {
+        runChurn(opt.duration);
+        elapsed = (nowNs() - t0) / 1e9;
+    } else {
+        std::cerr << "loadgen: connecting " << conns.size() << " clients\n";
+        ok = setup();
+        std::cerr << "loadgen: setup " << (nowNs() - t0) / 1e6 << " ms, "
+                  << joined << " ready, " << errors << " errors\n";
+        pickTargets();
+        t0 = nowNs();
+        if (ok) runTraffic(expected);
+        elapsed = (nowNs() - t0) / 1e9;
+        unsigned long end = nowNs() + (unsigned long)(opt.drain * 1e9);
+        while (received < expected && nowNs() < end) pump(10);
+    }
+    for (size_t i = 0; i < conns.size(); ++i) shut(conns[i]);
+
+    bool churn = opt.scenario == "churn";
+    std::printf("{\"label\":\"%s\",\"scenario\":\"%s\",\"clients\":%lu,\"ok\":%s,"
+                "\"duration_s\":%.3f,\"sent\":%lu,\"expected\":%lu,\"received\":%lu,"
+                "\"msgs_per_sec\":%.1f,\"deliveries_per_sec\":%.1f,\"cycles_per_sec\":%.1f,"
+                "\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f,"
+                "\"bytes_out\":%lu,\"bytes_in\":%lu,\"errors\":%lu,\"closed_early\":%lu}\n",
+                (opt.label.empty() ? opt.scenario : opt.label).c_str(), opt.scenario.c_str(),
+                (unsigned long)opt.clients, ok ? "true" : "false", elapsed, sent, expected, received,
+                elapsed > 0 ? sent / elapsed : 0, elapsed > 0 ? received / elapsed : 0,
+                churn && elapsed > 0 ? cycles / elapsed : 0,
+                lat.quantile(0.5) / 1e3, lat.quantile(0.99) / 1e3, lat.quantile(0.999) / 1e3,
+                bytesOut, bytesIn, (unsigned long)errors, (unsigned long)closedEarly);
+    return ok ? 0 : 1;
+}
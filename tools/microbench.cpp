@@ -0,0 +1,354 @@
+// microbench.cpp — ns/op and allocations/op for the hot helpers (parser,
+// casemapping, utils, reply builders), run over a corpus of client lines.
+// The input-path benchmarks (line scan, UTF-8, InBuf) run over a 1 MiB paste
+// of the corpus and also print GB/s; scanLine runs once per implementation,
+// after a check that every implementation agrees with the scalar one (exit 1
+// if not).
+//
+//   ./microbench [--corpus=tools/corpus.txt] [--ms=200] [--filter=SUBSTR]
+//                [--save=FILE] [--baseline=FILE] [--threshold=PCT]
+//
+// --save writes "name ns_per_op allocs_per_op" lines; --baseline compares
+// against such a file and exits 1 if any benchmark got slower than the
+// threshold (default 10%) or allocates more.
+
+#include "Parser.hpp"
+#include "Utils.hpp"
+#include "Replies.hpp"
+#include "CaseMap.hpp"
+#include "LineScan.hpp"
+#include "InBuf.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+
+// Every allocation in this process goes through here (single-threaded). Kept
+// out of line so the compiler does not pair an inlined malloc with delete.
+static unsigned long g_allocs = 0;
+
+__attribute__((noinline)) void *operator new(size_t n) throw(std::bad_alloc) {
+    ++g_allocs;
+    void *p = std::malloc(n ? n : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void *operator new[](size_t n) throw(std::bad_alloc) { return operator new(n); }
+__attribute__((noinline)) void operator delete(void *p) throw() { std::free(p); }
+void operator delete[](void *p) throw() { operator delete(p); }
+
+namespace {
+
+unsigned long nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000000000UL + (unsigned long)ts.tv_nsec;
+}
+
+volatile size_t g_sink; // keeps results alive
+
+std::vector<std::string> g_lines;  // corpus, without line endings
+std::vector<std::string> g_crlf;   // same, with "\r\n"
+std::vector<std::string> g_nicks;  // nick-ish words from the corpus
+std::vector<std::string> g_upper;  // g_nicks with case flipped
+std::vector<std::string> g_lists;  // comma lists ("#a,#b")
+std::vector<std::string> g_paste;  // one block: g_crlf repeated to 1 MiB
+std::vector<std::string> g_utf8;   // same, every line with some non-ASCII text
+CaseTable<int> *g_table;
+
+// One op = one pass over the relevant corpus slice; results are per item.
+typedef size_t (*BenchFn)();
+
+size_t bParse() {
+    size_t s = 0;
+    IrcMessage m;
+    for (size_t i = 0; i < g_lines.size(); ++i)
+        s += parseIrcLine(g_lines[i].data(), g_lines[i].size(), m) + m.params.size();
+    return s;
+}
+size_t bTrim() {
+    size_t s = 0;
+    for (size_t i = 0; i < g_crlf.size(); ++i) s += trimCRLF(g_crlf[i]).size();
+    return s;
+}
+size_t bSplit() {
+    size_t s = 0;
+    for (size_t i = 0; i < g_lists.size(); ++i) s += split(g_lists[i], ',').size();
+    return s;
+}
+size_t bValidNick() {
+    size_t s = 0;
+    for (size_t i = 0; i < g_nicks.size(); ++i) s += isValidNick(g_nicks[i]);
+    return s;
+}
+size_t bCaseHash() {
+    size_t s = 0;
+    for (size_t i = 0; i < g_nicks.size(); ++i)
+        s += caseHash(CASEMAP_RFC1459, g_nicks[i].data(), g_nicks[i].size());
+    return s;
+}
+size_t bCaseEqual() {
+    size_t s = 0;
+    for (size_t i = 0; i < g_nicks.size(); ++i)
+        s += caseEqual(CASEMAP_RFC1459, g_nicks[i].data(), g_upper[i].data(), g_nicks[i].size());
+    return s;
+}
+size_t bTableFind() {
+    size_t s = 0;
+    for (size_t i = 0; i < g_upper.size(); ++i) s += g_table->find(g_upper[i]) != 0;
+    return s;
+}
+size_t bItostr() {
+    size_t s = 0;
+    for (size_t i = 0; i < g_nicks.size(); ++i) s += itostr((int)(i * 7919)).size();
+    return s;
+}
+size_t bScanLine() {
+    // Frame every line of the paste, as the read path does.
+    const std::string &b = g_paste[0];
+    size_t lines = 0, at = 0;
+    unsigned flags = 0;
+    while (at < b.size()) {
+        at += scanLine(b.data() + at, b.size() - at, flags) + 1;
+        ++lines;
+    }
+    return lines + flags;
+}
+size_t bValidUtf8() {
+    return validUtf8(g_utf8[0].data(), g_utf8[0].size());
+}
+size_t bInBufIngest() {
+    // recv()-sized reads into an InBuf, lines consumed after each read.
+    const std::string &b = g_paste[0];
+    InBuf in;
+    size_t lines = 0;
+    for (size_t at = 0; at < b.size(); at += 4096) {
+        size_t n = b.size() - at < 4096 ? b.size() - at : 4096;
+        std::memcpy(in.space(n), b.data() + at, n);
+        in.commit(n);
+        for (size_t pos; (pos = in.findLine()) != InBuf::NPOS; ++lines) in.consume(pos + 1);
+    }
+    return lines;
+}
+// Every scanLine() implementation the CPU has must give the scalar offsets and
+// flags: from every start offset of the UTF-8 paste's head, and of a copy with
+// NULs and CRs sprinkled in (bare, before LF, and ending the range).
+bool scanImplsAgree() {
+    std::string tricky = g_utf8[0].substr(0, 8192);
+    const char extra[] = { '\0', '\r', '\r', '\n', '\x80' };
+    for (size_t i = 0; i < tricky.size(); i += 7 + i % 13) tricky[i] = extra[i % sizeof(extra)];
+    const std::string *bufs[] = { &g_utf8[0], &tricky };
+    const char *impls[] = { "avx2", "sse2" };
+    bool ok = true;
+    for (size_t k = 0; k < sizeof(impls) / sizeof(impls[0]); ++k) {
+        if (!useLineScanImpl(impls[k])) continue;
+        for (size_t b = 0; b < 2; ++b) {
+            const std::string &s = *bufs[b];
+            for (size_t at = 0; at < 8192 && at < s.size(); ++at) {
+                size_t n = (s.size() - at) < 1 + at % 300 ? s.size() - at : 1 + at % 300;
+                unsigned f = 0, fs = 0;
+                size_t r = scanLine(s.data() + at, n, f);
+                useLineScanImpl("scalar");
+                size_t rs = scanLine(s.data() + at, n, fs);
+                useLineScanImpl(impls[k]);
+                if (r != rs || f != fs) {
+                    std::printf("scanLine/%s disagrees at %lu+%lu: offset %lu flags %u, scalar %lu %u\n",
+                                impls[k], (unsigned long)at, (unsigned long)n, (unsigned long)r, f,
+                                (unsigned long)rs, fs);
+                    ok = false;
+                    break;
+                }
+            }
+        }
+    }
+    return ok;
+}
+const std::string kServer = "ft_irc.min";
+size_t bRplWelcome() {
+    size_t s = 0;
+    for (size_t i = 0; i < g_nicks.size(); ++i) s += RPL::welcome(kServer, g_nicks[i]).size();
+    return s;
+}
+size_t bRplNamreply() {
+    size_t s = 0;
+    for (size_t i = 0; i < g_nicks.size(); ++i)
+        s += RPL::namreply(kServer, g_nicks[i], "#general", "@alice bob carol dave eve mallory").size();
+    return s;
+}
+size_t bRplTopic() {
+    size_t s = 0;
+    for (size_t i = 0; i < g_nicks.size(); ++i)
+        s += RPL::topic(kServer, g_nicks[i], "#dev", "Release 2.3 freeze on Friday").size();
+    return s;
+}
+size_t bErrNeedMore() {
+    size_t s = 0;
+    for (size_t i = 0; i < g_nicks.size(); ++i) s += ERR::needmoreparams(kServer, g_nicks[i], "JOIN").size();
+    return s;
+}
+size_t bErrNoSuchNick() {
+    size_t s = 0;
+    for (size_t i = 0; i < g_nicks.size(); ++i) s += ERR::nosuchnick(kServer, g_nicks[i], g_upper[i]).size();
+    return s;
+}
+
+struct Bench {
+    const char *name;
+    BenchFn     fn;
+    const std::vector<std::string> *items; // op count per pass; a paste also gives GB/s
+};
+
+struct Result {
+    double ns;
+    double allocs;
+};
+
+Result measure(const Bench &b, unsigned long budgetNs) {
+    g_sink += b.fn(); // warm-up
+    size_t per = b.items->size() ? b.items->size() : 1;
+    unsigned long passes = 0, a0 = g_allocs, t0 = nowNs(), t = t0;
+    while (t - t0 < budgetNs || passes < 3) {
+        g_sink += b.fn();
+        ++passes;
+        t = nowNs();
+    }
+    Result r;
+    r.ns = (double)(t - t0) / (passes * per);
+    r.allocs = (double)(g_allocs - a0) / (passes * per);
+    return r;
+}
+
+std::map<std::string, Result> loadBaseline(const std::string &path) {
+    std::map<std::string, Result> m;
+    std::ifstream in(path.c_str());
+    std::string name;
+    Result r;
+    while (in >> name >> r.ns >> r.allocs) m[name] = r;
+    return m;
+}
+
+void flipCase(std::string &s) {
+    for (size_t i = 0; i < s.size(); ++i) {
+        char c = s[i];
+        if (c >= 'a' && c <= '~') s[i] = c - 32;
+        else if (c >= 'A' && c <= '^') s[i] = c + 32;
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    std::string corpus = "tools/corpus.txt", save, baseline, filter;
+    unsigned long ms = 200;
+    double threshold = 10;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        size_t eq = a.find('=');
+        std::string k = a.substr(0, eq), v = eq == std::string::npos ? "" : a.substr(eq + 1);
+        if (k == "--corpus") corpus = v;
+        else if (k == "--save") save = v;
+        else if (k == "--baseline") baseline = v;
+        else if (k == "--filter") filter = v;
+        else if (k == "--ms") ms = std::strtoul(v.c_str(), 0, 10);
+        else if (k == "--threshold") threshold = std::atof(v.c_str());
+        else {
+            std::cerr << "usage: " << argv[0] << " [--corpus=FILE] [--ms=N] [--filter=S]"
+                      << " [--save=FILE] [--baseline=FILE] [--threshold=PCT]\n";
+            return 2;
+        }
+    }
+
+    std::ifstream in(corpus.c_str());
+    if (!in) { std::cerr << "cannot read corpus " << corpus << "\n"; return 2; }
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+        if (line.empty()) continue;
+        g_lines.push_back(line);
+        g_crlf.push_back(line + "\r\n");
+        // Words that look like nicks or channels feed the name benchmarks.
+        std::istringstream ws(line);
+        std::string w;
+        while (ws >> w) {
+            if (w[0] == ':' || w[0] == '@') continue;
+            if (w.find(',') != std::string::npos) g_lists.push_back(w);
+            else if (w.size() <= NICKLEN) g_nicks.push_back(w);
+        }
+    }
+    if (g_lists.empty()) g_lists.push_back("#a,#b,#c");
+    std::string block, utf8;
+    while (block.size() < (1 << 20))
+        for (size_t i = 0; i < g_crlf.size(); ++i) {
+            block += g_crlf[i];
+            utf8 += g_lines[i] + " \xc3\xa9t\xc3\xa9 \xe2\x9c\x93 \xe6\x97\xa5\xe6\x9c\xac\r\n";
+        }
+    g_paste.push_back(block);
+    g_utf8.push_back(utf8);
+    g_upper = g_nicks;
+    for (size_t i = 0; i < g_upper.size(); ++i) flipCase(g_upper[i]);
+    CaseTable<int> table(CASEMAP_RFC1459);
+    for (size_t i = 0; i < g_nicks.size(); ++i) table.set(g_nicks[i], (int)i);
+    g_table = &table;
+
+    const Bench benches[] = {
+        { "parseIrcLine",        bParse,         &g_lines },
+        { "trimCRLF",            bTrim,          &g_crlf },
+        { "split",               bSplit,         &g_lists },
+        { "isValidNick",         bValidNick,     &g_nicks },
+        { "caseHash",            bCaseHash,      &g_nicks },
+        { "caseEqual",           bCaseEqual,     &g_nicks },
+        { "CaseTable::find",     bTableFind,     &g_upper },
+        { "itostr",              bItostr,        &g_nicks },
+        { "RPL::welcome",        bRplWelcome,    &g_nicks },
+        { "RPL::namreply",       bRplNamreply,   &g_nicks },
+        { "RPL::topic",          bRplTopic,      &g_nicks },
+        { "ERR::needmoreparams", bErrNeedMore,   &g_nicks },
+        { "ERR::nosuchnick",     bErrNoSuchNick, &g_nicks },
+        { "scanLine/avx2",       bScanLine,      &g_paste },
+        { "scanLine/sse2",       bScanLine,      &g_paste },
+        { "scanLine/scalar",     bScanLine,      &g_paste },
+        { "validUtf8",           bValidUtf8,     &g_utf8 },
+        { "InBuf::ingest",       bInBufIngest,   &g_paste }
+    };
+    const std::string best = lineScanImpl();
+    if (!scanImplsAgree()) return 1;
+    std::map<std::string, Result> base;
+    if (!baseline.empty()) base = loadBaseline(baseline);
+    std::ofstream out;
+    if (!save.empty()) out.open(save.c_str());
+
+    std::printf("%-22s %10s %10s", "benchmark", "ns/op", "allocs/op");
+    if (!base.empty()) std::printf(" %10s %8s", "base ns", "delta");
+    std::printf("\n");
+    bool regressed = false;
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i) {
+        const Bench &b = benches[i];
+        if (!filter.empty() && std::string(b.name).find(filter) == std::string::npos) continue;
+        const char *impl = std::strchr(b.name, '/');
+        if (!useLineScanImpl(impl ? impl + 1 : best.c_str())) {
+            std::printf("%-22s %10s\n", b.name, "n/a");
+            continue;
+        }
+        Result r = measure(b, ms * 1000000UL);
+        std::printf("%-22s %10.1f %10.2f", b.name, r.ns, r.allocs);
+        if (b.items == &g_paste || b.items == &g_utf8)
+            std::printf(" %6.2f GB/s", (*b.items)[0].size() / r.ns);
+        std::map<std::string, Result>::iterator it = base.find(b.name);
+        if (it != base.end()) {
+            double delta = (r.ns - it->second.ns) / it->second.ns * 100;
+            bool worse = delta > threshold || r.allocs > it->second.allocs + 0.005;
+            regressed = regressed || worse;
+            std::printf(" %10.1f %+7.1f%%%s", it->second.ns, delta, worse ? "  REGRESSION" : "");
+        }
+        std::printf("\n");
+        if (out) out << b.name << " " << r.ns << " " << r.allocs << "\n";
+    }
+    return regressed ? 1 : 0;
+}
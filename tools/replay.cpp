@@ -0,0 +1,239 @@
+// replay.cpp — re-drive a session recorded with `ircserv --capture=PATH`
+// against a running ircserv (Linux, epoll).
+//
+//   ./replay --port=6667 [--host=127.0.0.1] [--speed=1] capture.bin
+//
+// Each captured connection gets its own socket, opened, fed and closed in
+// record order. --speed=1 keeps the original timing, --speed=10 runs ten
+// times faster and --speed=0 sends as fast as the server accepts it; the order
+// of records is kept either way. Server output is read and thrown away. The
+// capture holds the original PASS lines, so start the server with the same
+// password. Prints one JSON summary line on stdout.
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+
+namespace {
+
+unsigned long nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000000000UL + (unsigned long)ts.tv_nsec;
+}
+
+struct Record {
+    unsigned long at;    // ns since capture start
+    unsigned long conn;
+    unsigned char type;  // 0 open, 1 data, 2 close (see include/Capture.hpp)
+    std::string   data;
+};
+
+struct Conn {
+    int         fd;
+    bool        connected;
+    bool        closing;   // close once out is flushed
+    bool        pollOut;
+    std::string out;
+    Conn() : fd(-1), connected(false), closing(false), pollOut(false) {}
+};
+
+std::string g_host = "127.0.0.1";
+int g_port = 6667;
+double g_speed = 1;
+int g_ep = -1;
+std::map<unsigned long, Conn> g_conns;
+unsigned long g_bytesOut = 0, g_bytesIn = 0, g_opened = 0, g_failed = 0;
+
+unsigned long getLE(const unsigned char *p, size_t n) {
+    unsigned long v = 0;
+    for (size_t i = 0; i < n; ++i) v |= (unsigned long)p[i] << (8 * i);
+    return v;
+}
+
+bool load(const char *path, std::vector<Record> &out) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[8];
+    if (!in.read(magic, 8) || std::memcmp(magic, "IRCCAP1\n", 8) != 0) {
+        std::cerr << path << ": not a capture file\n";
+        return false;
+    }
+    unsigned char h[21];
+    while (in.read(reinterpret_cast<char *>(h), sizeof(h))) {
+        Record r;
+        r.at = getLE(h, 8);
+        r.conn = getLE(h + 8, 8);
+        r.type = h[16];
+        size_t len = getLE(h + 17, 4);
+        r.data.resize(len);
+        if (len && !in.read(&r.data[0], len)) break; // truncated tail: keep what we have
+        out.push_back(r);
+    }
+    return true;
+}
+
+void watch(unsigned long id, Conn &c, int op) {
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | (c.pollOut ? (unsigned)EPOLLOUT : 0u);
+    ev.data.u64 = id;
+    epoll_ctl(g_ep, op, c.fd, &ev);
+}
+
+void drop(unsigned long id) {
+    std::map<unsigned long, Conn>::iterator it = g_conns.find(id);
+    if (it == g_conns.end()) return;
+    if (it->second.fd >= 0) ::close(it->second.fd);
+    g_conns.erase(it);
+}
+
+void flush(unsigned long id, Conn &c) {
+    if (!c.connected) return;
+    while (!c.out.empty()) {
+        ssize_t n = ::send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+        if (n <= 0) break;
+        g_bytesOut += n;
+        c.out.erase(0, n);
+    }
+    if (c.out.empty() && c.closing) { drop(id); return; }
+    bool want = !c.out.empty();
+    if (want != c.pollOut) {
+        c.pollOut = want;
+        watch(id, c, EPOLL_CTL_MOD);
+    }
+}
+
+void openConn(unsigned long id) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) { std::perror("socket"); ++g_failed; return; }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct sockaddr_in a;
+    std::memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_port = htons(g_port);
+    inet_pton(AF_INET, g_host.c_str(), &a.sin_addr);
+    if (::connect(fd, (struct sockaddr *)&a, sizeof(a)) < 0 && errno != EINPROGRESS) {
+        ::close(fd);
+        ++g_failed;
+        return;
+    }
+    Conn &c = g_conns[id];
+    c.fd = fd;
+    c.pollOut = true; // tells us when the connect completes
+    watch(id, c, EPOLL_CTL_ADD);
+    ++g_opened;
+}
+
+void apply(const Record &r) {
+    if (r.type == 0) { openConn(r.conn); return; }
+    std::map<unsigned long, Conn>::iterator it = g_conns.find(r.conn);
+    if (it == g_conns.end()) return; // connect failed or opened before the capture
+    if (r.type == 1) {
+        it->second.out += r.data;
+        flush(r.conn, it->second);
+    } else {
+        it->second.closing = true;
+        if (it->second.out.empty() && it->second.connected) drop(r.conn);
+    }
+}
+
+void pump(int timeoutMs) {
+    struct epoll_event evs[512];
+    int n = epoll_wait(g_ep, evs, 512, timeoutMs);
+    for (int i = 0; i < n; ++i) {
+        unsigned long id = evs[i].data.u64;
+        std::map<unsigned long, Conn>::iterator it = g_conns.find(id);
+        if (it == g_conns.end()) continue;
+        Conn &c = it->second;
+        if (!c.connected && (evs[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err) { ++g_failed; drop(id); continue; }
+            c.connected = true;
+        }
+        if (evs[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            char buf[65536];
+            ssize_t r;
+            while ((r = ::recv(c.fd, buf, sizeof(buf), 0)) > 0) g_bytesIn += r;
+            if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) { drop(id); continue; }
+        }
+        flush(id, c);
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    const char *path = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a.compare(0, 7, "--host=") == 0) g_host = a.substr(7);
+        else if (a.compare(0, 7, "--port=") == 0) g_port = std::atoi(a.c_str() + 7);
+        else if (a.compare(0, 8, "--speed=") == 0) g_speed = std::atof(a.c_str() + 8);
+        else if (a[0] != '-' && !path) path = argv[i];
+        else path = 0, i = argc;
+    }
+    if (!path) {
+        std::cerr << "usage: " << argv[0] << " [--host=IP] [--port=N] [--speed=X|0] capture.bin\n";
+        return 2;
+    }
+    std::vector<Record> recs;
+    if (!load(path, recs)) return 1;
+    signal(SIGPIPE, SIG_IGN);
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    g_ep = epoll_create(1024);
+    if (g_ep < 0) { std::perror("epoll_create"); return 1; }
+
+    // Records are due at (at - first) / speed after we start; lag is how far
+    // behind schedule we got (the server or this tool could not keep up).
+    unsigned long t0 = nowNs(), maxLag = 0;
+    unsigned long first = recs.empty() ? 0 : recs[0].at;
+    for (size_t i = 0; i < recs.size(); ++i) {
+        if (g_speed > 0) {
+            unsigned long due = t0 + (unsigned long)((recs[i].at - first) / g_speed);
+            for (unsigned long now = nowNs(); now < due; now = nowNs())
+                pump((int)((due - now) / 1000000));
+            unsigned long lag = nowNs() - due;
+            if (lag > maxLag) maxLag = lag;
+        } else {
+            pump(0);
+        }
+        apply(recs[i]);
+    }
+    // Let the last output drain and the server answer.
+    unsigned long end = nowNs() + 2000000000UL;
+    while (!g_conns.empty() && nowNs() < end) pump(10);
+    double elapsed = (nowNs() - t0) / 1e9;
+    double span = recs.empty() ? 0 : (recs.back().at - first) / 1e9;
+    std::printf("{\"records\":%lu,\"connections\":%lu,\"failed\":%lu,\"bytes_out\":%lu,\"bytes_in\":%lu,"
+                "\"captured_s\":%.3f,\"elapsed_s\":%.3f,\"max_lag_ms\":%.3f}\n",
+                (unsigned long)recs.size(), g_opened, g_failed, g_bytesOut, g_bytesIn,
+                span, elapsed, maxLag / 1e6);
+    for (std::map<unsigned long, Conn>::iterator it = g_conns.begin(); it != g_conns.end(); ++it)
+        ::close(it->second.fd);
+    return g_failed ? 1 : 0;
+}